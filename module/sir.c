@@ -22,8 +22,16 @@
 #include <linux/errno.h>
 #include <linux/mutex.h> //Changed since LDD3
 #include <linux/kallsyms.h>
+#include <linux/kprobes.h>
+#include <linux/percpu.h>
+#include <linux/version.h>
 #include <linux/irqflags.h>
 #include <linux/interrupt.h>
+#include <linux/cpu.h>
+#include <linux/cpumask.h>
+#include <linux/mm.h>
+#include <linux/topology.h>
+#include <linux/string.h>
 #include <asm/hardirq.h>
 #include <asm/mce.h>
 #include <asm/desc.h>
@@ -67,29 +75,82 @@ struct file_operations sir_fops = {
 	.owner =          THIS_MODULE,
 	.llseek =         sir_llseek,
 	.read =           sir_read,
+	.poll =           sir_poll,
 	.unlocked_ioctl = sir_ioctl, //This changed from LDD3 (see https://lwn.net/Articles/119652/, thanks https://unix.stackexchange.com/questions/4711/what-is-the-difference-between-ioctl-unlocked-ioctl-and-compat-ioctl)
 	.open =           sir_open,
 	.release =        sir_release,
+#ifdef SIR_URING_CMD
+	.uring_cmd =      sir_uring_cmd,
+#endif
 };
 
-// ++ Function pointer for interrupt ++
-//The function which returns the number of archetecture
-//specific interrupts is unfortunatly not exported like
-//kstat_cpu_irqs_sum is.  Without it, we do not get the 
-//full picture of what interupts have occured on a 
-//particular CPU.  One solution is to find the 
-//address for this function at runtime and assign
-//it to a function pointer.  That is what the function
-//pointer below is for.
-
-//The function prototype was taken from 
-
-//TODO: This is a hacky solution to the problem as
-//the normal compiler checks are bypassed.  Therefore,
-//need to keep an eye on the function to make sure
-//the function prototype does not change.
-
-u64 (*arch_irq_stat_cpu_local) (unsigned int cpu) = NULL;
+// ++ Unexported Counters ++
+//The machine check counters (mce_exception_count and mce_poll_count) are
+//per-CPU variables defined in arch/x86/kernel/cpu/mcheck/mce.c which are not
+//exported.  Their addresses are resolved once in sir_init.  If they cannot be
+//resolved, the MCE counts are reported as 0 and are not included in
+//arch_irq_stat_sum.
+#ifdef CONFIG_X86_MCE
+unsigned int __percpu* mce_exception_count_local = NULL;
+unsigned int __percpu* mce_poll_count_local = NULL;
+#endif
+
+// ++ Snapshot Mode ++
+//By default, interrupts are disabled while the counters are gathered so that
+//the counters are a consistent snapshot.  This delays any interrupt which
+//arrives during the read.  When snapshot_retries is non-zero, the counters
+//are instead gathered with interrupts enabled and re-gathered if an interrupt
+//landed on the CPU during the read.  After snapshot_retries attempts, the
+//counters are gathered with interrupts disabled.
+static int snapshot_retries = 0;
+module_param(snapshot_retries, int, 0644);
+MODULE_PARM_DESC(snapshot_retries, "Gather counters with interrupts enabled, retrying up to this many times if an interrupt lands during the read (0 = always disable interrupts)");
+
+// ++ CPU Groups ++
+//Named groups of CPUs registered through SIR_IOCTL_GROUP_ADD.
+//These are shared by all open file handles.
+struct sir_group sir_groups[SIR_GROUP_MAX];
+DEFINE_MUTEX(sir_groups_lock);
+
+// ++ Shared Sampling Sessions ++
+//Sessions attached to through SIR_IOCTL_SESSION_ATTACH.  A session is freed
+//when the last file handle attached to it detaches.
+struct sir_session* sir_sessions[SIR_SESSION_MAX];
+DEFINE_MUTEX(sir_sessions_lock);
+
+// ++ IPI Attribution ++
+//Tables of the IPIs sent to each CPU (indexed by target CPU).  Only allocated
+//when the module is loaded with ipi_attribution=1 since the tracepoint probes
+//run on every IPI sent in the system.
+static int ipi_attribution = 0;
+module_param(ipi_attribution, int, 0444);
+MODULE_PARM_DESC(ipi_attribution, "Count the IPIs sent to each CPU by source CPU, task, and callback (read with SIR_IOCTL_IPI_GET)");
+struct sir_ipi_table* sir_ipi_tables = NULL;
+#ifdef SIR_IPI
+DEFINE_PER_CPU(struct sir_ipi_pending, sir_ipi_pending);
+#endif
+
+// ++ Tick Diagnostics ++
+//tick_nohz_tick_stopped_cpu and tick_cpu_device are not exported.  Their addresses
+//are resolved in sir_init.  If they cannot be resolved, the corresponding SIR_TICK
+//flags are not set.  tick_cpu_device is a per-CPU struct tick_device whose first
+//member is the clock event device for the tick.  The tick_stop tracepoint probe
+//runs on every tick stop attempt so it is only attached with tick_tracking=1.
+static int tick_tracking = 0;
+module_param(tick_tracking, int, 0444);
+MODULE_PARM_DESC(tick_tracking, "Count tick stops, restarts, and failed stops by dependency (read with SIR_IOCTL_GET_ALL_TICK)");
+#ifdef SIR_TICK
+bool (*tick_nohz_tick_stopped_cpu_local)(int cpu) = NULL;
+struct clock_event_device* __percpu* tick_cpu_device_local = NULL;
+DEFINE_PER_CPU(struct sir_tick_counters, sir_tick_counters);
+int sir_tick_tracked = 0;
+#endif
+
+// ++ Self Instrumentation ++
+#ifdef SIR_STATS
+DEFINE_PER_CPU(struct sir_cpu_stats, sir_stats);
+struct dentry* sir_debugfs_dir = NULL;
+#endif
 
 // ++ Softirq Indexes ++
 int num_other_softirqs = 0; //Indicates how many entries are in the softirq_other_indexs array
@@ -145,6 +206,176 @@ int find_softirq_indexes(void)
     return rtn;
 }
 
+//==== Self Instrumentation ====
+//Per-CPU statistics on the cost of each operation, measured with the cycle
+//counter (the TSC on x86).  The helpers compile to nothing without SIR_STATS.
+
+#ifdef SIR_STATS
+    #define sir_stats_inc(field) this_cpu_inc(sir_stats.field)
+#else
+    #define sir_stats_inc(field)
+#endif
+
+static inline u64 sir_stats_start(void){
+    #ifdef SIR_STATS
+        return get_cycles();
+    #else
+        return 0;
+    #endif
+}
+
+#ifdef SIR_STATS
+static inline void sir_stats_add(struct sir_op_stats* stats, u64 cycles){
+    int bucket = cycles == 0 ? 0 : SIR_MIN(ilog2(cycles), SIR_STATS_HIST_BUCKETS-1);
+
+    stats->calls++;
+    stats->total_cycles += cycles;
+    if(cycles > stats->max_cycles){
+        stats->max_cycles = cycles;
+    }
+    stats->hist[bucket]++;
+}
+#endif
+
+//Records the duration of an operation on the CPU it finished on
+static inline void sir_stats_end(int op, u64 start){
+    #ifdef SIR_STATS
+        u64 cycles = get_cycles() - start;
+        preempt_disable();
+        sir_stats_add(&(this_cpu_ptr(&sir_stats)->ops[op]), cycles);
+        preempt_enable();
+    #endif
+}
+
+//Records how long interrupts were disabled.  Called with interrupts disabled.
+static inline void sir_stats_irq_off(u64 start){
+    #ifdef SIR_STATS
+        sir_stats_add(&(this_cpu_ptr(&sir_stats)->irq_off), get_cycles() - start);
+    #endif
+}
+
+//Takes partial_state->lock, counting the calls which had to wait for another
+//user of the same file
+static inline void sir_lock_state(struct partial_read_state* partial_state){
+    #ifdef SIR_STATS
+        if(mutex_trylock(&(partial_state->lock))){
+            return;
+        }
+        sir_stats_inc(lock_contended);
+    #endif
+    mutex_lock(&(partial_state->lock));
+}
+
+static int sir_stat_ioctl_op(unsigned int cmd){
+    switch(cmd){
+        case SIR_IOCTL_GET: return SIR_STAT_GET;
+        case SIR_IOCTL_GET_DETAILED: return SIR_STAT_GET_DETAILED;
+        case SIR_IOCTL_GET_ALL: return SIR_STAT_GET_ALL;
+        case SIR_IOCTL_GET_ALL_TICK: return SIR_STAT_GET_ALL_TICK;
+        case SIR_IOCTL_GROUP_ADD:
+        case SIR_IOCTL_GROUP_REMOVE:
+        case SIR_IOCTL_GROUP_GET: return SIR_STAT_GROUP;
+        case SIR_IOCTL_IPI_GET:
+        case SIR_IOCTL_IPI_RESET:
+        case SIR_IOCTL_IPI_CLEAR: return SIR_STAT_IPI;
+        case SIR_IOCTL_SESSION_ATTACH:
+        case SIR_IOCTL_SESSION_DETACH:
+        case SIR_IOCTL_SESSION_READ: return SIR_STAT_SESSION;
+        case SIR_IOCTL_DISABLE_INTERRUPT:
+        case SIR_IOCTL_RESTORE_INTERRUPT: return SIR_STAT_IRQ_CONTROL;
+        default: return SIR_STAT_OTHER;
+    }
+}
+
+#ifdef SIR_STATS
+static const char* sir_stat_op_names[SIR_STAT_NUM_OPS] = {
+    "read",
+    "ioctl_get",
+    "ioctl_get_detailed",
+    "ioctl_get_all",
+    "ioctl_get_all_tick",
+    "ioctl_group",
+    "ioctl_ipi",
+    "ioctl_session",
+    "ioctl_irq_control",
+    "uring_get",
+    "uring_get_detailed",
+    "uring_get_all",
+    "other"
+};
+
+static void sir_stats_show_op(struct seq_file* m, const char* name, const struct sir_op_stats* stats){
+    int i;
+
+    if(stats->calls == 0){
+        return;
+    }
+
+    seq_printf(m, "\t%s: calls %llu, mean %llu cycles, max %llu cycles\n\t\t", name, stats->calls,
+               stats->total_cycles/stats->calls, stats->max_cycles);
+    for(i = 0; i<SIR_STATS_HIST_BUCKETS; i++){
+        if(stats->hist[i] > 0){
+            seq_printf(m, "[%llu,%llu): %llu ", 1ULL << i, 1ULL << (i+1), stats->hist[i]);
+        }
+    }
+    seq_puts(m, "\n");
+}
+
+static int sir_stats_show(struct seq_file* m, void* v){
+    int cpu;
+    int i;
+
+    #ifdef CONFIG_X86
+        seq_printf(m, "tsc_khz: %u\n", tsc_khz);
+    #endif
+
+    for_each_possible_cpu(cpu){
+        const struct sir_cpu_stats* stats = per_cpu_ptr(&sir_stats, cpu);
+        u64 calls = stats->irq_off.calls + stats->irq_off_user.calls + stats->lock_contended;
+
+        for(i = 0; i<SIR_STAT_NUM_OPS; i++){
+            calls += stats->ops[i].calls;
+        }
+        if(calls == 0){
+            continue;
+        }
+
+        seq_printf(m, "CPU %d:\n", cpu);
+        for(i = 0; i<SIR_STAT_NUM_OPS; i++){
+            sir_stats_show_op(m, sir_stat_op_names[i], &(stats->ops[i]));
+        }
+        sir_stats_show_op(m, "irq_off", &(stats->irq_off));
+        sir_stats_show_op(m, "irq_off_user", &(stats->irq_off_user));
+        seq_printf(m, "\tsnapshot_retries: %llu, snapshot_fallbacks: %llu, partial_reads: %llu, lock_contended: %llu\n",
+                   stats->snapshot_retries, stats->snapshot_fallbacks, stats->partial_reads, stats->lock_contended);
+    }
+
+    return 0;
+}
+
+static int sir_stats_open(struct inode* inode, struct file* file){
+    return single_open(file, sir_stats_show, NULL);
+}
+
+//Writing anything to the stats file resets them
+static ssize_t sir_stats_write(struct file* file, const char __user* buf, size_t count, loff_t* ppos){
+    int cpu;
+    for_each_possible_cpu(cpu){
+        memset(per_cpu_ptr(&sir_stats, cpu), 0, sizeof(struct sir_cpu_stats));
+    }
+    return count;
+}
+
+static const struct file_operations sir_stats_fops = {
+    .owner =   THIS_MODULE,
+    .open =    sir_stats_open,
+    .read =    seq_read,
+    .write =   sir_stats_write,
+    .llseek =  seq_lseek,
+    .release = single_release,
+};
+#endif
+
 //==== Char Driver Functons ====
 
 //Each time the device is opened, a small amount
@@ -201,6 +432,11 @@ int sir_open(struct inode *inode, struct file *filp)
     partial_state->softirq_other = 0; //Other softirqs that are not one of the above
 
     partial_state->ind = 0;
+    partial_state->ipi_baseline = NULL;
+    partial_state->session = NULL;
+    partial_state->session_cursor = 0;
+    INIT_LIST_HEAD(&(partial_state->session_node));
+    init_waitqueue_head(&(partial_state->session_wait));
 
     for(i = 0; i<CONFIG_NR_CPUS; i++){
         partial_state->irq_flags[i] = 0;
@@ -218,8 +454,16 @@ int sir_open(struct inode *inode, struct file *filp)
 //The data 
 int sir_release(struct inode *inode, struct file *filp)
 {
+    struct partial_read_state* partial_state = (struct partial_read_state*) filp->private_data;
+
+    //**** Detach from the Sampling Session ****
+    if(partial_state->session != NULL){
+        sir_session_detach(partial_state);
+    }
+
     //**** Free Partial Read Data ****
-    kfree(filp->private_data);
+    kvfree(partial_state->ipi_baseline);
+    kfree(partial_state);
 
     printkd(KERN_INFO "sir: Released Device\n");
 
@@ -252,12 +496,13 @@ ssize_t sir_read(struct file *filp, char __user *buf, size_t count, loff_t *f_po
 {
     struct partial_read_state* partial_state = (struct partial_read_state*) filp->private_data;
     ssize_t final_count = 0;
+    u64 stats_start = sir_stats_start();
 
     //TODO: Check cpu even when there is partial data
     printkd(KERN_INFO "sir: Read\n");
 
     //To protect against multiple threads having the sample file handle, a mutex is used
-    mutex_lock(&(partial_state->lock));
+    sir_lock_state(partial_state);
 
     //First, check if any partial read results are present
     
@@ -266,6 +511,7 @@ ssize_t sir_read(struct file *filp, char __user *buf, size_t count, loff_t *f_po
         int remaining_to_write;
 
         printkd("sir: Returning previous partial result\n");
+        sir_stats_inc(partial_reads);
 
         if(partial_state->ind >= sizeof(partial_state->irq_std)){
             printk(KERN_WARNING "sir: Unexpected index durring read: %d\n", partial_state->ind);
@@ -292,21 +538,13 @@ ssize_t sir_read(struct file *filp, char __user *buf, size_t count, loff_t *f_po
         }
     }else{
         int remaining_to_write;
-        unsigned long irq_flags;
 
         //No partial data avail, get new data
         int cpu = get_cpu(); //Also disables premption which is important for the kstat functions
 
-        //Disable Interrupts to get accurate interrupt and softirq counts
-        //This is based on the "Disabling all interrupts" section of Ch. 10 of LDD3
-        local_irq_save(irq_flags);
-
-        //This only gets the non-arch specific interrupts
-        partial_state->irq_std = kstat_cpu_irqs_sum(cpu); //Thanks to https://stackoverflow.com/questions/3700536/get-interrupt-counters-like-proc-interrupts-from-code for pointing in the right direction
-        partial_state->irq_std += arch_irq_stat_cpu_local(cpu); //This gets the archetecture specific interrupts
-        
-        //Re-enable interrupts before copying results to user
-        local_irq_restore(irq_flags);
+        //Gets the non-arch specific and archetecture specific interrupts
+        sir_snapshot_total(cpu, partial_state);
+        partial_state->irq_std += partial_state->arch_irq_stat_sum;
         
         put_cpu(); //Re-enables premption
 
@@ -324,6 +562,7 @@ ssize_t sir_read(struct file *filp, char __user *buf, size_t count, loff_t *f_po
             partial_state->ind = 0;
         }else{
             partial_state->ind = final_count;
+            sir_stats_inc(partial_reads);
         }
     }
 
@@ -331,6 +570,8 @@ ssize_t sir_read(struct file *filp, char __user *buf, size_t count, loff_t *f_po
 
     mutex_unlock(&(partial_state->lock));
 
+    sir_stats_end(SIR_STAT_READ, stats_start);
+
     return final_count;
 }
 
@@ -360,90 +601,105 @@ inline void get_softirqs(int cpu, struct partial_read_state* state){
     state->softirq_other = other_sum;
 }
 
+//Reads the components of arch_irq_stat_cpu (arch/x86/kernel/irq.c, not exported)
+//directly from irq_stat and returns their sum.  If state is not NULL, each component
+//with a report field is also stored in it, so the fields always add up to the sum.
+//The gates match the fields of irq_cpustat_t.
+#define SIR_ARCH_IRQ_ADD(field, val) \
+    do{ \
+        SIR_INTERRUPT_TYPE component = (val); \
+        sum += component; \
+        if(state != NULL){ \
+            state->field = component; \
+        } \
+    }while(0)
+
+static __always_inline SIR_INTERRUPT_TYPE sir_arch_irq_stat(int cpu, struct partial_read_state* state){
+    SIR_INTERRUPT_TYPE sum = 0;
+
+    SIR_ARCH_IRQ_ADD(irq_nmi, irq_stats(cpu)->__nmi_count);
+    #ifdef CONFIG_X86_LOCAL_APIC
+        SIR_ARCH_IRQ_ADD(irq_loc, irq_stats(cpu)->apic_timer_irqs);
+        SIR_ARCH_IRQ_ADD(irq_spu, irq_stats(cpu)->irq_spurious_count);
+        SIR_ARCH_IRQ_ADD(irq_pmi, irq_stats(cpu)->apic_perf_irqs);
+        SIR_ARCH_IRQ_ADD(irq_iwi, irq_stats(cpu)->apic_irq_work_irqs);
+        SIR_ARCH_IRQ_ADD(irq_rtr, irq_stats(cpu)->icr_read_retry_count);
+
+        //x86_platform_ipi_callback is not exported so the counter is read directly.
+        //It is only incremented when the platform IPI vector is taken which does
+        //not occur unless a callback is registered.
+        SIR_ARCH_IRQ_ADD(irq_plt, irq_stats(cpu)->x86_platform_ipis);
+    #endif
+    #ifdef CONFIG_SMP
+        SIR_ARCH_IRQ_ADD(irq_res, irq_stats(cpu)->irq_resched_count);
+        SIR_ARCH_IRQ_ADD(irq_cal, irq_stats(cpu)->irq_call_count);
+    #endif
+    #ifdef CONFIG_X86_THERMAL_VECTOR
+        SIR_ARCH_IRQ_ADD(irq_trm, irq_stats(cpu)->irq_thermal_count);
+    #endif
+    #ifdef CONFIG_X86_MCE_THRESHOLD
+        SIR_ARCH_IRQ_ADD(irq_thr, irq_stats(cpu)->irq_threshold_count);
+    #endif
+    #ifdef SIR_HV_CALLBACK
+        //system_vectors is not exported so the counter is read directly.
+        //It is only incremented when the hypervisor callback vector is taken.
+        SIR_ARCH_IRQ_ADD(irq_hyp, irq_stats(cpu)->irq_hv_callback_count);
+    #endif
+    #if IS_ENABLED(CONFIG_HYPERV)
+        //Hyper-V reenlightenment and stimer0 interrupts (HRE and HVS) do not have
+        //their own report fields but are part of the arch total
+        sum += irq_stats(cpu)->irq_hv_reenlightenment_count;
+        sum += irq_stats(cpu)->hyperv_stimer0_count;
+    #endif
+    #ifdef CONFIG_X86_MCE
+        //The mce_exception_count and mce_poll_count variables are not exported
+        //and are resolved in sir_init
+        if(mce_exception_count_local != NULL && mce_poll_count_local != NULL){
+            SIR_ARCH_IRQ_ADD(mce_exception, *per_cpu_ptr(mce_exception_count_local, cpu));
+            SIR_ARCH_IRQ_ADD(mce_poll, *per_cpu_ptr(mce_poll_count_local, cpu));
+        }
+    #endif
+
+    return sum;
+}
+
+#undef SIR_ARCH_IRQ_ADD
+
 inline void get_interrupts(int cpu, struct partial_read_state* partial_state){
     //This function stores the indevidual components of the sum that arch_irq_stat_cpu 
     //computes.
     partial_state->irq_std = kstat_cpu_irqs_sum(cpu); //Get the standard (non x86 specific) interrupts
 
-    partial_state->irq_nmi = irq_stats(cpu)->__nmi_count;
-    #ifdef CONFIG_X86_LOCAL_APIC
-        partial_state->irq_loc = irq_stats(cpu)->apic_timer_irqs;
-        partial_state->irq_spu = irq_stats(cpu)->irq_spurious_count;
-        partial_state->irq_pmi = irq_stats(cpu)->apic_perf_irqs;
-        partial_state->irq_iwi = irq_stats(cpu)->apic_irq_work_irqs;
-        partial_state->irq_rtr = irq_stats(cpu)->icr_read_retry_count;
-
-        //TODO: x86_platform_ipi_callback is not exported
-        //      Will not track this for now.  This is tracked
-        //      by arch_irq_stat_cpu_local however so can be obtained via that
-        //
-        // if (x86_platform_ipi_callback) {
-        //     partial_state->irq_plt = irq_stats(cpu)->x86_platform_ipis;
-        // }else{
-            partial_state->irq_plt = 0;
-        // }
-    #else
-        partial_state->irq_loc = 0;
-        partial_state->irq_spu = 0;
-        partial_state->irq_pmi = 0;
-        partial_state->irq_iwi = 0;
-        partial_state->irq_rtr = 0;
-        partial_state->irq_plt = 0;
-    #endif
-
+    //Components which are not available in this kernel configuration are reported as 0
+    partial_state->irq_nmi = 0;
+    partial_state->irq_loc = 0;
+    partial_state->irq_spu = 0;
+    partial_state->irq_pmi = 0;
+    partial_state->irq_iwi = 0;
+    partial_state->irq_rtr = 0;
+    partial_state->irq_plt = 0;
+    partial_state->irq_res = 0;
+    partial_state->irq_cal = 0;
+    partial_state->irq_trm = 0;
+    partial_state->irq_thr = 0;
+    partial_state->irq_hyp = 0;
+    partial_state->mce_exception = 0;
+    partial_state->mce_poll = 0;
+    partial_state->arch_irq_stat_sum = sir_arch_irq_stat(cpu, partial_state);
+
+    //Counted in irq_stat but not part of arch_irq_stat_cpu
     #ifdef CONFIG_SMP
-		partial_state->irq_res = irq_stats(cpu)->irq_resched_count;
-		partial_state->irq_cal = irq_stats(cpu)->irq_call_count;
 		partial_state->irq_tlb = irq_stats(cpu)->irq_tlb_count;
     #else
-        partial_state->irq_res = 0;
-		partial_state->irq_cal = 0;
 		partial_state->irq_tlb = 0;
     #endif
 
-    #ifdef CONFIG_X86_THERMAL_VECTOR
-		partial_state->irq_trm = irq_stats(cpu)->irq_thermal_count;
-    #else
-        partial_state->irq_trm = 0;
-    #endif
-
-    #ifdef CONFIG_X86_MCE_THRESHOLD
-		partial_state->irq_thr = irq_stats(cpu)->irq_threshold_count;
-    #else
-        partial_state->irq_thr = 0;
-    #endif
-
     #ifdef CONFIG_X86_MCE_AMD
 		partial_state->irq_dfr = irq_stats(cpu)->irq_deferred_error_count;
     #else
         partial_state->irq_dfr = 0;
     #endif
 
-    #ifdef CONFIG_X86_MCE
-        //TODO: The mce_exception_count and mce_poll_count variables are
-        //      not exported and are defined in arch/x86/kernel/cpu/mcheck/mce.c
-        //      Will not track for now bit is tracked in arch_irq_stat_cpu_local
-        //
-        // partial_state->mce_exception = per_cpu(mce_exception_count, cpu);
-		// partial_state->mce_poll = per_cpu(mce_poll_count, cpu);
-        partial_state->mce_exception = 0;
-		partial_state->mce_poll = 0;
-    #else
-        partial_state->mce_exception = 0;
-		partial_state->mce_poll = 0;
-    #endif
-
-    #if IS_ENABLED(CONFIG_HYPERV) || defined(CONFIG_XEN)
-        //TODO: system_vectors is not exported and will not be tracked for now
-        // if (test_bit(HYPERVISOR_CALLBACK_VECTOR, system_vectors)) {
-        //     partial_state->irq_hyp = irq_stats(cpu)->irq_hv_callback_count;
-        // }else{
-            partial_state->irq_hyp = 0;
-        // }
-    #else
-        partial_state->irq_hyp = 0;
-    #endif
-
     #ifdef CONFIG_HAVE_KVM
 		partial_state->irq_pin = irq_stats(cpu)->kvm_posted_intr_ipis;
 		partial_state->irq_npi = irq_stats(cpu)->kvm_posted_intr_nested_ipis;
@@ -454,10 +710,6 @@ inline void get_interrupts(int cpu, struct partial_read_state* partial_state){
 		partial_state->irq_piw = 0;
     #endif
 
-    //TODO: Collect the sum of interrupts using the provided function.  This also sums up some of
-    //      interrupts that were not exported and not tracked above.
-    partial_state->arch_irq_stat_sum = arch_irq_stat_cpu_local(cpu);
-
     get_softirqs(cpu, partial_state);
 }
 
@@ -498,144 +750,1949 @@ inline void copy_interrupt_report(struct partial_read_state* partial_state, stru
         report->softirq_other = partial_state->softirq_other; //Other softirqs that are not one of the above
 }
 
-//As an alternative to using the char driver, the current interrupt
-//can be accessed using a ioctl call.
-//The value is returned to a pointer provided from the userspace in ARG
-//This pointer must be to a 64 bit value.
-//This method was used instead of directly using the return value
-//due to how the kenel inspects the return value for negative numbers.
-//This would require additional calls to IOCTL to determine the MSB
-//as the MSB would need to be stripped from any return value
-long sir_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
-{
-    struct partial_read_state* partial_state = (struct partial_read_state*) filp->private_data;
-    unsigned long irq_flags = 0;
-    long rtn_val = -EINVAL;
-    int cpu;
+inline void get_interrupt_total(int cpu, struct partial_read_state* partial_state){
+    //This only gets the non-arch specific interrupts
+    partial_state->irq_std = kstat_cpu_irqs_sum(cpu); //Thanks to https://stackoverflow.com/questions/3700536/get-interrupt-counters-like-proc-interrupts-from-code for pointing in the right direction
+    partial_state->arch_irq_stat_sum = sir_arch_irq_stat(cpu, NULL); //This gets the archetecture specific interrupts
+}
 
-    printkd(KERN_INFO "sir: ioctl cmd: %x arg: %lx\n", cmd, arg);
+//Reads a single counter for a CPU.  idx is the index of the field in struct sir_report
+//or one of the SIR_PMU_EVENT totals.  Counters which are not available in this kernel
+//configuration read as 0.  Safe to call from atomic context.
+u64 sir_counter_value(int cpu, unsigned int idx){
+    u64 val = 0;
+    int i;
 
-    mutex_lock(&(partial_state->lock));
+    switch(idx){
+        case 0: return kstat_cpu_irqs_sum(cpu);
+        case 1: return irq_stats(cpu)->__nmi_count;
+        #ifdef CONFIG_X86_LOCAL_APIC
+        case 2: return irq_stats(cpu)->apic_timer_irqs;
+        case 3: return irq_stats(cpu)->irq_spurious_count;
+        case 4: return irq_stats(cpu)->apic_perf_irqs;
+        case 5: return irq_stats(cpu)->apic_irq_work_irqs;
+        case 6: return irq_stats(cpu)->icr_read_retry_count;
+        case 7: return irq_stats(cpu)->x86_platform_ipis;
+        #endif
+        #ifdef CONFIG_SMP
+        case 8: return irq_stats(cpu)->irq_resched_count;
+        case 9: return irq_stats(cpu)->irq_call_count;
+        case 10: return irq_stats(cpu)->irq_tlb_count;
+        #endif
+        #ifdef CONFIG_X86_THERMAL_VECTOR
+        case 11: return irq_stats(cpu)->irq_thermal_count;
+        #endif
+        #ifdef CONFIG_X86_MCE_THRESHOLD
+        case 12: return irq_stats(cpu)->irq_threshold_count;
+        #endif
+        #ifdef CONFIG_X86_MCE_AMD
+        case 13: return irq_stats(cpu)->irq_deferred_error_count;
+        #endif
+        #ifdef CONFIG_X86_MCE
+        case 14: return mce_exception_count_local != NULL ? *per_cpu_ptr(mce_exception_count_local, cpu) : 0;
+        case 15: return mce_poll_count_local != NULL ? *per_cpu_ptr(mce_poll_count_local, cpu) : 0;
+        #endif
+        #ifdef SIR_HV_CALLBACK
+        case 16: return irq_stats(cpu)->irq_hv_callback_count;
+        #endif
+        #ifdef CONFIG_HAVE_KVM
+        case 17: return irq_stats(cpu)->kvm_posted_intr_ipis;
+        case 18: return irq_stats(cpu)->kvm_posted_intr_nested_ipis;
+        case 19: return irq_stats(cpu)->kvm_posted_intr_wakeup_ipis;
+        #endif
+        case 20: return sir_arch_irq_stat(cpu, NULL);
+        case 21: return kstat_softirqs_cpu(HI_SOFTIRQ, cpu);
+        case 22: return kstat_softirqs_cpu(TIMER_SOFTIRQ, cpu);
+        case 23: return kstat_softirqs_cpu(NET_TX_SOFTIRQ, cpu);
+        case 24: return kstat_softirqs_cpu(NET_RX_SOFTIRQ, cpu);
+        case 25: return kstat_softirqs_cpu(BLOCK_SOFTIRQ, cpu);
+        case 26: return kstat_softirqs_cpu(IRQ_POLL_SOFTIRQ, cpu);
+        case 27: return kstat_softirqs_cpu(TASKLET_SOFTIRQ, cpu);
+        case 28: return kstat_softirqs_cpu(SCHED_SOFTIRQ, cpu);
+        case 29: return kstat_softirqs_cpu(HRTIMER_SOFTIRQ, cpu);
+        case 30: return kstat_softirqs_cpu(RCU_SOFTIRQ, cpu);
+        case 31:
+            for(i = 0; i<num_other_softirqs; i++){
+                val += kstat_softirqs_cpu(softirq_other_idxs[i], cpu);
+            }
+            return val;
+        case SIR_PMU_EVENT_IRQ_TOTAL:
+            return kstat_cpu_irqs_sum(cpu) + sir_arch_irq_stat(cpu, NULL);
+        case SIR_PMU_EVENT_SOFTIRQ_TOTAL:
+            for(i = 0; i<NR_SOFTIRQS; i++){
+                val += kstat_softirqs_cpu(i, cpu);
+            }
+            return val;
+        default:
+            return 0;
+    }
+}
 
-    cpu = get_cpu();
+//Returns 1 if only the change of the counter modulo 2^32 is meaningful.  This is
+//the case for the 32 bit kernel counters and for the sums of them (arch_irq_stat_sum,
+//softirq_other, and softirq_total), which drop by 2^32 when any of them wraps.
+//irq_std is 64 bits and irq_total mixes the two (see sir_pmu_event_update).
+int sir_counter_is_32bit(unsigned int idx){
+    return (idx >= 1 && idx <= 31) || idx == SIR_PMU_EVENT_SOFTIRQ_TOTAL;
+}
 
-    if(cmd == SIR_IOCTL_GET)
-    {
-        u64* rtn_ptr = (u64*) arg;
-        SIR_INTERRUPT_TYPE irq_sum;
+//Returns the sum of the counters which are incremented when a hardware interrupt
+//(or NMI) lands on the CPU.  Softirqs are not included since, with preemption
+//disabled, they only run on the exit from a hardware interrupt.
+//Built from sir_arch_irq_stat (which reads the raw irq_stat fields even when the
+//reported value is 0, ex. PLT) plus the vectors which are counted in irq_stat but
+//are not part of the arch total.
+static inline SIR_INTERRUPT_TYPE sir_irq_marker(int cpu){
+    SIR_INTERRUPT_TYPE marker = kstat_cpu_irqs_sum(cpu) + sir_arch_irq_stat(cpu, NULL);
 
-        //Disable Interrupts to get accurate interrupt and softirq counts
-        //This is based on the "Disabling all interrupts" section of Ch. 10 of LDD3
-        local_irq_save(irq_flags);
+    #ifdef CONFIG_X86_MCE_AMD
+        marker += irq_stats(cpu)->irq_deferred_error_count;
+    #endif
+    #ifdef CONFIG_HAVE_KVM
+        marker += irq_stats(cpu)->kvm_posted_intr_ipis;
+        marker += irq_stats(cpu)->kvm_posted_intr_nested_ipis;
+        marker += irq_stats(cpu)->kvm_posted_intr_wakeup_ipis;
+    #endif
 
-        partial_state->irq_std = kstat_cpu_irqs_sum(cpu);
-        partial_state->arch_irq_stat_sum = arch_irq_stat_cpu_local(cpu);
-        
-        //Re-enable interrupts before copying results to user
-        local_irq_restore(irq_flags);
+    return marker;
+}
 
-        irq_sum = partial_state->irq_std + partial_state->arch_irq_stat_sum;
-        copy_to_user(rtn_ptr, &(irq_sum), sizeof(irq_sum));
-        printkd(KERN_INFO "sir: ioctl get (CPU %d): %lld\n", cpu, irq_sum);
-        rtn_val = 0; //Success
-    } else if(cmd == SIR_IOCTL_GET_DETAILED){
-        struct sir_report* rtn_ptr = (struct sir_report*) arg;
-        struct sir_report report;
+//Gathers counters for the current CPU using the configured snapshot mode.
+//Must be called with preemption disabled.
+static __always_inline void sir_snapshot(int cpu, struct partial_read_state* partial_state, void (*gather)(int, struct partial_read_state*)){
+    unsigned long irq_flags;
+    u64 irq_off_start;
+    int retries = READ_ONCE(snapshot_retries);
+    int i;
 
-        //Disable Interrupts to get accurate interrupt and softirq counts
-        //This is based on the "Disabling all interrupts" section of Ch. 10 of LDD3
-        local_irq_save(irq_flags);
+    //Retry Mode: the read is consistent if no interrupt landed between the two marker reads
+    for(i = 0; i<retries; i++){
+        SIR_INTERRUPT_TYPE before = sir_irq_marker(cpu);
+        barrier();
+        gather(cpu, partial_state);
+        barrier();
+        if(sir_irq_marker(cpu) == before){
+            return;
+        }
+        sir_stats_inc(snapshot_retries);
+    }
+    if(retries > 0){
+        sir_stats_inc(snapshot_fallbacks);
+    }
 
+    //Disable Interrupts to get accurate interrupt and softirq counts
+    //This is based on the "Disabling all interrupts" section of Ch. 10 of LDD3
+    local_irq_save(irq_flags);
+    irq_off_start = sir_stats_start();
+
+    gather(cpu, partial_state);
+
+    //Re-enable interrupts before copying results to user
+    sir_stats_irq_off(irq_off_start);
+    local_irq_restore(irq_flags);
+}
+
+//Gathers irq_std and arch_irq_stat_sum
+void sir_snapshot_total(int cpu, struct partial_read_state* partial_state){
+    sir_snapshot(cpu, partial_state, get_interrupt_total);
+}
+
+//Gathers the full interrupt breakdown
+void sir_snapshot_detailed(int cpu, struct partial_read_state* partial_state){
+    sir_snapshot(cpu, partial_state, get_interrupts);
+}
+
+inline void add_interrupt_report(struct partial_read_state* partial_state, struct sir_report* report){
+        report->irq_std += partial_state->irq_std;
+        report->irq_nmi += partial_state->irq_nmi;
+        report->irq_loc += partial_state->irq_loc;
+        report->irq_spu += partial_state->irq_spu;
+        report->irq_pmi += partial_state->irq_pmi;
+        report->irq_iwi += partial_state->irq_iwi;
+        report->irq_rtr += partial_state->irq_rtr;
+        report->irq_plt += partial_state->irq_plt;
+        report->irq_res += partial_state->irq_res;
+        report->irq_cal += partial_state->irq_cal;
+        report->irq_tlb += partial_state->irq_tlb;
+        report->irq_trm += partial_state->irq_trm;
+        report->irq_thr += partial_state->irq_thr;
+        report->irq_dfr += partial_state->irq_dfr;
+        report->mce_exception += partial_state->mce_exception;
+        report->mce_poll += partial_state->mce_poll;
+        report->irq_hyp += partial_state->irq_hyp;
+        report->irq_pin += partial_state->irq_pin;
+        report->irq_npi += partial_state->irq_npi;
+        report->irq_piw += partial_state->irq_piw;
+        report->arch_irq_stat_sum += partial_state->arch_irq_stat_sum;
+
+        report->softirq_hi += partial_state->softirq_hi;
+        report->softirq_timer += partial_state->softirq_timer;
+        report->softirq_net_tx += partial_state->softirq_net_tx;
+        report->softirq_net_rx += partial_state->softirq_net_rx;
+        report->softirq_block += partial_state->softirq_block;
+        report->softirq_irq_poll += partial_state->softirq_irq_poll;
+        report->softirq_tasklet += partial_state->softirq_tasklet;
+        report->softirq_sched += partial_state->softirq_sched;
+        report->softirq_hrtimer += partial_state->softirq_hrtimer;
+        report->softirq_rcu += partial_state->softirq_rcu;
+        report->softirq_other += partial_state->softirq_other;
+}
+
+//Collects the interrupt report for every CPU in a single call.
+//Remote CPUs are read without stopping them so no IPIs are sent to
+//the CPUs being measured.  The counters for a remote CPU can
+//advance while being read so the report for a remote CPU is not an
+//atomic snapshot but each counter is individually consistent.
+//If with_tick is set, the entries are struct sir_tick_report and the
+//tick state is gathered in the same pass (SIR_IOCTL_GET_ALL_TICK).
+//Expects partial_state->lock to be held.  Must be called from a
+//context which can sleep.
+long sir_get_all(struct partial_read_state* partial_state, unsigned long arg, int with_tick){
+    struct sir_batch __user* batch_ptr = (struct sir_batch __user*) arg;
+    struct sir_batch batch;
+    size_t entry_size = with_tick ? sizeof(struct sir_tick_report) : sizeof(struct sir_report);
+    char* entries;
+    unsigned int num_reports;
+    int cpu;
+    long rtn_val = 0;
+
+    if(copy_from_user(&batch, batch_ptr, sizeof(batch)) != 0){
+        return -EFAULT;
+    }
+
+    num_reports = SIR_MIN(batch.num_reports, nr_cpu_ids);
+
+    entries = (char*) kvcalloc(num_reports > 0 ? num_reports : 1, entry_size, GFP_KERNEL);
+    if(entries == NULL){
+        printk(KERN_WARNING "sir: Could not allocate data for batch read\n");
+        return -ENOMEM;
+    }
+
+    //Hold off CPU hotplug so the online mask is stable while the CPUs are read
+    cpus_read_lock();
+    for_each_online_cpu(cpu){
+        if(cpu >= num_reports){
+            break;
+        }
         get_interrupts(cpu, partial_state);
+        if(with_tick){
+            struct sir_tick_report* tick_report = (struct sir_tick_report*) (entries + cpu*entry_size);
+            copy_interrupt_report(partial_state, &(tick_report->report));
+            get_tick_state(cpu, &(tick_report->tick));
+        }else{
+            copy_interrupt_report(partial_state, (struct sir_report*) (entries + cpu*entry_size));
+        }
+    }
+    cpus_read_unlock();
 
-        //Re-enable interrupts before copying results to user
-        local_irq_restore(irq_flags);
+    batch.num_reports = num_reports;
+    batch.num_cpus = nr_cpu_ids;
 
-        copy_interrupt_report(partial_state, &report);
-        copy_to_user(rtn_ptr, &report, sizeof(report));
-        printkd(KERN_INFO "sir: ioctl get detail (CPU %d)\n", cpu);
-        rtn_val = 0; //Success
-    } else if(cmd == SIR_IOCTL_DISABLE_INTERRUPT){
-        //Disable Interrupts to get accurate interrupt and softirq counts
-        //This is based on the "Disabling all interrupts" section of Ch. 10 of LDD3
-        local_irq_save(irq_flags);
-        partial_state->irq_flags[cpu] = irq_flags;
-        rtn_val = 0; //Success
-    } else if(cmd == SIR_IOCTL_RESTORE_INTERRUPT){
-        //Re-enable interrupts before copying results to user
-        irq_flags = partial_state->irq_flags[cpu];
-        local_irq_restore(irq_flags);
-        rtn_val = 0; //Success
-    } else {
-        rtn_val = -ENOTTY;
-        printkd(KERN_INFO "sir: ioctl default: %ld\n", rtn_val);
+    if(copy_to_user((void __user*) (uintptr_t) batch.reports, entries, num_reports*entry_size) != 0 ||
+       copy_to_user(batch_ptr, &batch, sizeof(batch)) != 0){
+        rtn_val = -EFAULT;
     }
 
-    mutex_unlock(&(partial_state->lock));
+    printkd(KERN_INFO "sir: ioctl get all (%u CPUs)\n", num_reports);
 
-    put_cpu();
+    kvfree(entries);
 
     return rtn_val;
 }
 
-// ==== Init / Cleanup Functions ====
-static void sir_cleanup(void)
-{
-    if(cdevp != NULL){
-        cdev_del(cdevp);
-        printkd(KERN_INFO "sir: Unregistered sir0\n");
+//==== Tracepoint Helpers ====
+#ifdef SIR_TRACEPOINTS
+//A probe to attach to a kernel tracepoint.  Arrays are terminated by an entry with a NULL name.
+struct sir_tracepoint{
+    const char* name;
+    void* probe;
+    int required;           //Registration fails if the tracepoint does not exist in this kernel
+    struct tracepoint* tp;
+    int registered;
+};
+
+//The tracepoints are not exported so they are found by name
+static void sir_find_tracepoint(struct tracepoint* tp, void* priv){
+    struct sir_tracepoint* sir_tps = (struct sir_tracepoint*) priv;
+    int i;
+    for(i = 0; sir_tps[i].name != NULL; i++){
+        if(strcmp(tp->name, sir_tps[i].name) == 0){
+            sir_tps[i].tp = tp;
+        }
     }
+}
 
-    if(sir_major >= 0){
-        unregister_chrdev_region(dev, 1);
-        printkd(KERN_INFO "sir: Unregistered Region\n");
+//Unregisters the probes.  The caller must call tracepoint_synchronize_unregister
+//before freeing anything the probes use.
+static void sir_tracepoints_unregister(struct sir_tracepoint* sir_tps){
+    int i;
+    for(i = 0; sir_tps[i].name != NULL; i++){
+        if(sir_tps[i].registered){
+            tracepoint_probe_unregister(sir_tps[i].tp, sir_tps[i].probe, NULL);
+            sir_tps[i].registered = 0;
+        }
     }
 }
 
-static int sir_init(void)
-{
-    //**** Get a pointer to arch_irq_stat_cpu ****
-    //Thanks for the pointer https://stackoverflow.com/questions/40431194/how-do-i-access-any-kernel-symbol-in-a-kernel-module
-    //This is unfortuantly a suboptomal solution that will need to be kept track of.
+//Registers the probes.  Optional tracepoints which do not exist are skipped.
+//If a required tracepoint is missing or a probe cannot be registered, all probes
+//are unregistered and an error is returned.
+static int sir_tracepoints_register(struct sir_tracepoint* sir_tps){
     int status;
+    int i;
 
-    #if !(CONFIG_X86)
-        printk(KERN_WARNING "sir: This module only supports x86");
-        sir_cleanup();
-        return -EFAULT;
-    #endif
+    for_each_kernel_tracepoint(sir_find_tracepoint, sir_tps);
+
+    for(i = 0; sir_tps[i].name != NULL; i++){
+        if(sir_tps[i].tp == NULL){
+            if(sir_tps[i].required){
+                printk(KERN_WARNING "sir: Unable to find tracepoint %s\n", sir_tps[i].name);
+                sir_tracepoints_unregister(sir_tps);
+                return -ENOENT;
+            }
+            printk(KERN_INFO "sir: Tracepoint %s not found, skipping\n", sir_tps[i].name);
+            continue;
+        }
 
-    //Get the softirq entries
-    status = find_softirq_indexes();
-    if(status != 0){
-        sir_cleanup();
-        return -EFAULT;
+        status = tracepoint_probe_register(sir_tps[i].tp, sir_tps[i].probe, NULL);
+        if(status != 0){
+            printk(KERN_WARNING "sir: Unable to register probe for %s: %d\n", sir_tps[i].name, status);
+            sir_tracepoints_unregister(sir_tps);
+            return status;
+        }
+        sir_tps[i].registered = 1;
     }
 
-    preempt_disable();
-    arch_irq_stat_cpu_local = (typeof(arch_irq_stat_cpu_local)) kallsyms_lookup_name("arch_irq_stat_cpu");
-    preempt_enable();
-    if(arch_irq_stat_cpu_local == NULL)
-    {
-        printk(KERN_WARNING "sir: Unable to find arch_irq_stat_cpu");
-        sir_cleanup();
-        return -EFAULT;
+    return 0;
+}
+#endif
+
+//==== Tick Diagnostics ====
+//Reports why the tick is (or is not) stopped on each CPU.  The stopped state and
+//next timer event are read directly.  The stop and failure counts come from the
+//tick_stop tracepoint, which fires on the CPU whenever the tick is stopped or a
+//dependency prevents it from being stopped.
+
+#ifdef SIR_TICK
+static void sir_tick_stop_probe(void* data, int success, int dependency){
+    struct sir_tick_counters* counters = this_cpu_ptr(&sir_tick_counters);
+    int bit;
+
+    if(success){
+        counters->tick_stops++;
+        return;
     }
 
-    //**** Create Device ****
-    status = alloc_chrdev_region(&dev, 0, 1, "sir");
-    if(status < 0){
-        //Error Allocating Device
-        sir_cleanup();
-        return -ENOMEM;
+    counters->stop_failures++;
+    WRITE_ONCE(counters->last_dependency, dependency);
+    if(dependency == 0){
+        counters->dependency_counts[SIR_TICK_DEP_OTHER]++;
+    }
+    for(bit = 0; bit<SIR_TICK_DEP_OTHER; bit++){
+        if(dependency & (1 << bit)){
+            counters->dependency_counts[bit]++;
+        }
     }
+}
 
-    sir_major = MAJOR(dev);
-    sir_minor = MINOR(dev);
-    
-    printkd(KERN_INFO "sir: Dev Number - Major: %d, Minor: %d\n", sir_major, sir_minor);
+static struct sir_tracepoint sir_tick_tracepoints[] = {
+    {"tick_stop", sir_tick_stop_probe, 1, NULL, 0},
+    {NULL, NULL, 0, NULL, 0}
+};
+#endif
 
-    //**** Create and Register Char Dev ****
+//Gathers the tick state of a CPU.  Remote CPUs are read without locking so the
+//fields are individually consistent.  Expects the CPU hotplug lock to be held.
+void get_tick_state(int cpu, struct sir_tick_state* tick){
+    memset(tick, 0, sizeof(struct sir_tick_state));
+    tick->next_event_ns = U64_MAX;
+
+    #ifdef CONFIG_NO_HZ_FULL
+        if(tick_nohz_full_cpu(cpu)){
+            tick->flags |= SIR_TICK_NOHZ_FULL;
+        }
+    #endif
+
+    #ifdef SIR_TICK
+        if(tick_nohz_tick_stopped_cpu_local != NULL){
+            tick->flags |= SIR_TICK_STATE_VALID;
+            if(tick_nohz_tick_stopped_cpu_local(cpu)){
+                tick->flags |= SIR_TICK_STOPPED;
+            }
+        }
+
+        if(tick_cpu_device_local != NULL){
+            struct clock_event_device* evtdev = READ_ONCE(*per_cpu_ptr(tick_cpu_device_local, cpu));
+            if(evtdev != NULL){
+                ktime_t next_event = READ_ONCE(evtdev->next_event);
+                tick->flags |= SIR_TICK_NEXT_VALID;
+                tick->next_event_ns = next_event == KTIME_MAX ? U64_MAX : ktime_to_ns(next_event);
+            }
+        }
+
+        if(sir_tick_tracked){
+            struct sir_tick_counters* counters = per_cpu_ptr(&sir_tick_counters, cpu);
+            int i;
+
+            tick->flags |= SIR_TICK_TRACKED;
+            tick->tick_stops = READ_ONCE(counters->tick_stops);
+            tick->stop_failures = READ_ONCE(counters->stop_failures);
+            tick->last_dependency = READ_ONCE(counters->last_dependency);
+            for(i = 0; i<SIR_TICK_NUM_DEPS; i++){
+                tick->dependency_counts[i] = READ_ONCE(counters->dependency_counts[i]);
+            }
+
+            //Every stop other than the current one was followed by a restart
+            tick->tick_restarts = tick->tick_stops;
+            if(tick->tick_restarts > 0 && (tick->flags & SIR_TICK_STOPPED)){
+                tick->tick_restarts--;
+            }
+        }
+    #endif
+}
+
+//==== CPU Groups ====
+
+//Returns the group with the given name or NULL if it does not exist.
+//Expects sir_groups_lock to be held.
+static struct sir_group* sir_group_find(const char* name){
+    int i;
+    for(i = 0; i<SIR_GROUP_MAX; i++){
+        if(sir_groups[i].in_use && strncmp(sir_groups[i].name, name, SIR_GROUP_NAME_LEN) == 0){
+            return &(sir_groups[i]);
+        }
+    }
+    return NULL;
+}
+
+//Registers (or replaces) a named group of CPUs.
+//The SMT siblings are resolved when the group is added.
+long sir_group_add(unsigned long arg){
+    struct sir_group_def* def;
+    struct sir_group* group;
+    cpumask_var_t siblings;
+    int cpu;
+    int i;
+    long rtn_val = 0;
+
+    //The definition and cpumask are too large to keep on the kernel stack
+    def = (struct sir_group_def*) kmalloc(sizeof(struct sir_group_def), GFP_KERNEL);
+    if(def == NULL){
+        return -ENOMEM;
+    }
+    if(!alloc_cpumask_var(&siblings, GFP_KERNEL)){
+        kfree(def);
+        return -ENOMEM;
+    }
+
+    if(copy_from_user(def, (void __user*) arg, sizeof(struct sir_group_def)) != 0){
+        rtn_val = -EFAULT;
+        goto out;
+    }
+    def->name[SIR_GROUP_NAME_LEN-1] = '\0';
+    if(def->name[0] == '\0'){
+        rtn_val = -EINVAL;
+        goto out;
+    }
+
+    mutex_lock(&sir_groups_lock);
+
+    group = sir_group_find(def->name);
+    if(group == NULL){
+        for(i = 0; i<SIR_GROUP_MAX; i++){
+            if(!sir_groups[i].in_use){
+                group = &(sir_groups[i]);
+                break;
+            }
+        }
+    }
+
+    if(group == NULL){
+        rtn_val = -ENOSPC;
+    }else{
+        cpumask_clear(&(group->mask));
+        for(cpu = 0; cpu<SIR_MIN(SIR_GROUP_MAX_CPUS, nr_cpu_ids); cpu++){
+            if((def->cpus[cpu/64] >> (cpu%64)) & 1){
+                cpumask_set_cpu(cpu, &(group->mask));
+            }
+        }
+
+        if(def->flags & SIR_GROUP_SMT_SIBLINGS){
+            cpumask_copy(siblings, &(group->mask));
+            for_each_cpu(cpu, siblings){
+                cpumask_or(&(group->mask), &(group->mask), topology_sibling_cpumask(cpu));
+            }
+        }
+
+        strscpy(group->name, def->name, SIR_GROUP_NAME_LEN);
+        group->in_use = 1;
+        printkd(KERN_INFO "sir: Added group %s (%u CPUs)\n", group->name, cpumask_weight(&(group->mask)));
+    }
+
+    mutex_unlock(&sir_groups_lock);
+
+out:
+    free_cpumask_var(siblings);
+    kfree(def);
+
+    return rtn_val;
+}
+
+long sir_group_remove(unsigned long arg){
+    char name[SIR_GROUP_NAME_LEN];
+    struct sir_group* group;
+    long rtn_val = 0;
+
+    //Only the name is needed from the group definition
+    if(copy_from_user(name, (void __user*) arg, SIR_GROUP_NAME_LEN) != 0){
+        return -EFAULT;
+    }
+    name[SIR_GROUP_NAME_LEN-1] = '\0';
+
+    mutex_lock(&sir_groups_lock);
+    group = sir_group_find(name);
+    if(group == NULL){
+        rtn_val = -ENOENT;
+    }else{
+        group->in_use = 0;
+        printkd(KERN_INFO "sir: Removed group %s\n", name);
+    }
+    mutex_unlock(&sir_groups_lock);
+
+    return rtn_val;
+}
+
+//Sums the reports for the online CPUs in a group in a single pass.
+//Like sir_get_all, the remote CPUs are read without being stopped.
+//Expects partial_state->lock to be held.
+long sir_group_get(struct partial_read_state* partial_state, unsigned long arg){
+    struct sir_group_report __user* rtn_ptr = (struct sir_group_report __user*) arg;
+    struct sir_group_report group_report;
+    struct sir_group* group;
+    int cpu;
+    long rtn_val = 0;
+
+    if(copy_from_user(group_report.name, rtn_ptr->name, SIR_GROUP_NAME_LEN) != 0){
+        return -EFAULT;
+    }
+    group_report.name[SIR_GROUP_NAME_LEN-1] = '\0';
+    group_report.num_cpus = 0;
+    group_report.reserved = 0;
+    memset(&(group_report.report), 0, sizeof(group_report.report));
+
+    mutex_lock(&sir_groups_lock);
+    group = sir_group_find(group_report.name);
+    if(group == NULL){
+        rtn_val = -ENOENT;
+    }else{
+        cpus_read_lock();
+        for_each_cpu_and(cpu, &(group->mask), cpu_online_mask){
+            get_interrupts(cpu, partial_state);
+            add_interrupt_report(partial_state, &(group_report.report));
+            group_report.num_cpus++;
+        }
+        cpus_read_unlock();
+    }
+    mutex_unlock(&sir_groups_lock);
+
+    if(rtn_val == 0 && copy_to_user(rtn_ptr, &group_report, sizeof(group_report)) != 0){
+        rtn_val = -EFAULT;
+    }
+
+    printkd(KERN_INFO "sir: ioctl group get %s (%u CPUs)\n", group_report.name, group_report.num_cpus);
+
+    return rtn_val;
+}
+
+//As an alternative to using the char driver, the current interrupt
+//can be accessed using a ioctl call.
+//The value is returned to a pointer provided from the userspace in ARG
+//This pointer must be to a 64 bit value.
+//This method was used instead of directly using the return value
+//due to how the kenel inspects the return value for negative numbers.
+//This would require additional calls to IOCTL to determine the MSB
+//as the MSB would need to be stripped from any return value
+long sir_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
+{
+    struct partial_read_state* partial_state = (struct partial_read_state*) filp->private_data;
+    unsigned long irq_flags = 0;
+    long rtn_val = -EINVAL;
+    int cpu;
+    u64 stats_start = sir_stats_start();
+
+    printkd(KERN_INFO "sir: ioctl cmd: %x arg: %lx\n", cmd, arg);
+
+    sir_lock_state(partial_state);
+
+    //The batch, group, IPI, and session commands allocate memory and copy from
+    //userspace so they are handled before preemption is disabled
+    if(cmd == SIR_IOCTL_GET_ALL || cmd == SIR_IOCTL_GET_ALL_TICK || cmd == SIR_IOCTL_GROUP_ADD ||
+       cmd == SIR_IOCTL_GROUP_REMOVE || cmd == SIR_IOCTL_GROUP_GET ||
+       cmd == SIR_IOCTL_IPI_GET || cmd == SIR_IOCTL_IPI_RESET || cmd == SIR_IOCTL_IPI_CLEAR ||
+       cmd == SIR_IOCTL_SESSION_ATTACH || cmd == SIR_IOCTL_SESSION_DETACH || cmd == SIR_IOCTL_SESSION_READ){
+        if(cmd == SIR_IOCTL_GET_ALL){
+            rtn_val = sir_get_all(partial_state, arg, 0);
+        }else if(cmd == SIR_IOCTL_GET_ALL_TICK){
+            rtn_val = sir_get_all(partial_state, arg, 1);
+        }else if(cmd == SIR_IOCTL_GROUP_ADD){
+            rtn_val = sir_group_add(arg);
+        }else if(cmd == SIR_IOCTL_GROUP_REMOVE){
+            rtn_val = sir_group_remove(arg);
+        }else if(cmd == SIR_IOCTL_GROUP_GET){
+            rtn_val = sir_group_get(partial_state, arg);
+        }else if(cmd == SIR_IOCTL_IPI_GET){
+            rtn_val = sir_ipi_get(partial_state, arg);
+        }else if(cmd == SIR_IOCTL_IPI_CLEAR){
+            rtn_val = sir_ipi_clear(arg);
+        }else if(cmd == SIR_IOCTL_SESSION_ATTACH){
+            rtn_val = sir_session_attach(partial_state, arg);
+        }else if(cmd == SIR_IOCTL_SESSION_DETACH){
+            rtn_val = sir_session_detach(partial_state);
+        }else if(cmd == SIR_IOCTL_SESSION_READ){
+            rtn_val = sir_session_read(partial_state, arg);
+        }else{
+            rtn_val = sir_ipi_reset(partial_state, arg);
+        }
+        mutex_unlock(&(partial_state->lock));
+        sir_stats_end(sir_stat_ioctl_op(cmd), stats_start);
+        return rtn_val;
+    }
+
+    cpu = get_cpu();
+
+    if(cmd == SIR_IOCTL_GET)
+    {
+        u64* rtn_ptr = (u64*) arg;
+        SIR_INTERRUPT_TYPE irq_sum;
+
+        sir_snapshot_total(cpu, partial_state);
+
+        irq_sum = partial_state->irq_std + partial_state->arch_irq_stat_sum;
+        copy_to_user(rtn_ptr, &(irq_sum), sizeof(irq_sum));
+        printkd(KERN_INFO "sir: ioctl get (CPU %d): %lld\n", cpu, irq_sum);
+        rtn_val = 0; //Success
+    } else if(cmd == SIR_IOCTL_GET_DETAILED){
+        struct sir_report* rtn_ptr = (struct sir_report*) arg;
+        struct sir_report report;
+
+        sir_snapshot_detailed(cpu, partial_state);
+
+        copy_interrupt_report(partial_state, &report);
+        copy_to_user(rtn_ptr, &report, sizeof(report));
+        printkd(KERN_INFO "sir: ioctl get detail (CPU %d)\n", cpu);
+        rtn_val = 0; //Success
+    } else if(cmd == SIR_IOCTL_DISABLE_INTERRUPT){
+        //Disable Interrupts to get accurate interrupt and softirq counts
+        //This is based on the "Disabling all interrupts" section of Ch. 10 of LDD3
+        local_irq_save(irq_flags);
+        partial_state->irq_flags[cpu] = irq_flags;
+        #ifdef SIR_STATS
+            this_cpu_write(sir_stats.irq_off_user_start, get_cycles());
+        #endif
+        rtn_val = 0; //Success
+    } else if(cmd == SIR_IOCTL_RESTORE_INTERRUPT){
+        //Re-enable interrupts before copying results to user
+        irq_flags = partial_state->irq_flags[cpu];
+        #ifdef SIR_STATS
+            if(this_cpu_read(sir_stats.irq_off_user_start) != 0){
+                sir_stats_add(&(this_cpu_ptr(&sir_stats)->irq_off_user), get_cycles() - this_cpu_read(sir_stats.irq_off_user_start));
+                this_cpu_write(sir_stats.irq_off_user_start, 0);
+            }
+        #endif
+        local_irq_restore(irq_flags);
+        rtn_val = 0; //Success
+    } else {
+        rtn_val = -ENOTTY;
+        printkd(KERN_INFO "sir: ioctl default: %ld\n", rtn_val);
+    }
+
+    mutex_unlock(&(partial_state->lock));
+
+    put_cpu();
+
+    sir_stats_end(sir_stat_ioctl_op(cmd), stats_start);
+
+    return rtn_val;
+}
+
+//==== IPI Attribution ====
+//The tracepoint probes run on the CPU which sends the IPI and record it in the
+//table of each target CPU.  The table for a target is only contended when
+//several CPUs send it an IPI at the same time.
+
+#ifdef SIR_IPI
+//Records an IPI (or a queued cross-CPU call if is_call is set) sent to target
+static void sir_ipi_record(unsigned int target, u32 kind, unsigned long func, int is_call){
+    struct sir_ipi_table* table;
+    struct sir_ipi_slot* slot = NULL;
+    char comm[SIR_IPI_COMM_LEN];
+    unsigned long irq_flags;
+    u32 src_cpu = raw_smp_processor_id();
+    u32 hash;
+    int i;
+
+    if(target >= nr_cpu_ids){
+        return;
+    }
+    table = &(sir_ipi_tables[target]);
+
+    memset(comm, 0, SIR_IPI_COMM_LEN);
+    if(in_hardirq()){
+        strscpy(comm, "<hardirq>", SIR_IPI_COMM_LEN);
+    }else if(in_serving_softirq()){
+        strscpy(comm, "<softirq>", SIR_IPI_COMM_LEN);
+    }else{
+        strscpy(comm, current->comm, SIR_IPI_COMM_LEN);
+    }
+
+    hash = jhash(comm, SIR_IPI_COMM_LEN, jhash_3words((u32) func, src_cpu, kind, 0));
+
+    //The lock may already be held by the code this NMI interrupted
+    if(in_nmi()){
+        if(!raw_spin_trylock_irqsave(&(table->lock), irq_flags)){
+            atomic64_inc(&(table->dropped));
+            return;
+        }
+    }else{
+        raw_spin_lock_irqsave(&(table->lock), irq_flags);
+    }
+
+    for(i = 0; i<SIR_IPI_TABLE_SIZE; i++){
+        struct sir_ipi_slot* candidate = &(table->slots[(hash+i) & (SIR_IPI_TABLE_SIZE-1)]);
+        if(!candidate->in_use){
+            candidate->src_cpu = src_cpu;
+            candidate->kind = kind;
+            candidate->func = func;
+            memcpy(candidate->comm, comm, SIR_IPI_COMM_LEN);
+            candidate->in_use = 1;
+            slot = candidate;
+            break;
+        }
+        if(candidate->func == func && candidate->src_cpu == src_cpu && candidate->kind == kind &&
+           memcmp(candidate->comm, comm, SIR_IPI_COMM_LEN) == 0){
+            slot = candidate;
+            break;
+        }
+    }
+
+    if(slot == NULL){
+        atomic64_inc(&(table->dropped));
+    }else if(is_call){
+        slot->count.calls++;
+    }else{
+        slot->count.ipis++;
+    }
+
+    raw_spin_unlock_irqrestore(&(table->lock), irq_flags);
+}
+
+//Returns the function to count a call IPI against.  The IPIs for cross-CPU calls are
+//traced with generic_smp_call_function_single_interrupt as the callback no matter which
+//function was queued.  csd_queue_cpu fires just before the IPI on the same CPU (with
+//preemption disabled) so the IPI is counted against the function it queued, in the same
+//entry as the call.  This is best effort: a call queued from an interrupt between the two
+//replaces the function.  If mask is NULL, the IPI is only matched to the queued call if
+//it goes to the same CPU.
+static unsigned long sir_ipi_call_func(unsigned int cpu, const struct cpumask* mask, void* callback){
+    struct sir_ipi_pending* pending = this_cpu_ptr(&sir_ipi_pending);
+    unsigned long func = (unsigned long) callback;
+
+    if(pending->target >= 0 && (mask != NULL || pending->target == cpu)){
+        func = pending->func;
+        pending->target = -1;
+    }
+
+    return func;
+}
+
+//Reschedule IPIs are traced without a callback
+static void sir_ipi_send_cpu_probe(void* data, const unsigned int cpu, unsigned long callsite, void* callback){
+    if(callback == NULL){
+        sir_ipi_record(cpu, SIR_IPI_KIND_RESCHED, callsite, 0);
+    }else{
+        sir_ipi_record(cpu, SIR_IPI_KIND_CALL, sir_ipi_call_func(cpu, NULL, callback), 0);
+    }
+}
+
+//smp_call_function_many_cond queues the same function on every CPU before sending one IPI to the mask
+static void sir_ipi_send_cpumask_probe(void* data, const struct cpumask* cpumask, unsigned long callsite, void* callback){
+    unsigned long func = callback == NULL ? 0 : sir_ipi_call_func(0, cpumask, callback);
+    int cpu;
+
+    for_each_cpu(cpu, cpumask){
+        if(callback == NULL){
+            sir_ipi_record(cpu, SIR_IPI_KIND_RESCHED, callsite, 0);
+        }else{
+            sir_ipi_record(cpu, SIR_IPI_KIND_CALL, func, 0);
+        }
+    }
+}
+
+//Fires for every cross-CPU call, including calls which are queued behind an IPI already in flight
+static void sir_csd_queue_cpu_probe(void* data, const unsigned int cpu, unsigned long callsite, smp_call_func_t func, call_single_data_t* csd){
+    struct sir_ipi_pending* pending = this_cpu_ptr(&sir_ipi_pending);
+
+    pending->func = (unsigned long) func;
+    pending->target = cpu;
+    sir_ipi_record(cpu, SIR_IPI_KIND_CALL, (unsigned long) func, 1);
+}
+
+static struct sir_tracepoint sir_ipi_tracepoints[] = {
+    {"ipi_send_cpu", sir_ipi_send_cpu_probe, 1, NULL, 0},
+    {"ipi_send_cpumask", sir_ipi_send_cpumask_probe, 1, NULL, 0},
+    {"csd_queue_cpu", sir_csd_queue_cpu_probe, 1, NULL, 0},
+    {NULL, NULL, 0, NULL, 0}
+};
+
+static void sir_ipi_stop(void){
+    sir_tracepoints_unregister(sir_ipi_tracepoints);
+
+    //Wait for any probe which is still running before freeing the tables
+    tracepoint_synchronize_unregister();
+
+    kvfree(sir_ipi_tables);
+    sir_ipi_tables = NULL;
+}
+
+static int sir_ipi_start(void){
+    int cpu;
+    int status;
+
+    sir_ipi_tables = (struct sir_ipi_table*) kvcalloc(nr_cpu_ids, sizeof(struct sir_ipi_table), GFP_KERNEL);
+    if(sir_ipi_tables == NULL){
+        return -ENOMEM;
+    }
+    for(cpu = 0; cpu<nr_cpu_ids; cpu++){
+        raw_spin_lock_init(&(sir_ipi_tables[cpu].lock));
+        atomic64_set(&(sir_ipi_tables[cpu].dropped), 0);
+    }
+    for_each_possible_cpu(cpu){
+        per_cpu(sir_ipi_pending, cpu).target = -1;
+    }
+
+    status = sir_tracepoints_register(sir_ipi_tracepoints);
+    if(status != 0){
+        sir_ipi_stop();
+    }
+
+    return status;
+}
+#endif
+
+//Returns the table of IPIs sent to a CPU, relative to the last reset on this file handle.
+//Expects partial_state->lock to be held.
+long sir_ipi_get(struct partial_read_state* partial_state, unsigned long arg){
+#ifdef SIR_IPI
+    struct sir_ipi_query __user* query_ptr = (struct sir_ipi_query __user*) arg;
+    struct sir_ipi_query query;
+    struct sir_ipi_slot* slots;
+    struct sir_ipi_entry* entries;
+    struct sir_ipi_table* table;
+    char* symbol;
+    unsigned long irq_flags;
+    u64 generation;
+    unsigned int num_entries;
+    unsigned int written = 0;
+    unsigned int total = 0;
+    int i;
+    long rtn_val = 0;
+
+    if(sir_ipi_tables == NULL){
+        return -ENODEV;
+    }
+
+    if(copy_from_user(&query, query_ptr, sizeof(query)) != 0){
+        return -EFAULT;
+    }
+    if(query.cpu >= nr_cpu_ids){
+        return -EINVAL;
+    }
+    table = &(sir_ipi_tables[query.cpu]);
+    num_entries = SIR_MIN(query.num_entries, SIR_IPI_TABLE_SIZE);
+
+    slots = (struct sir_ipi_slot*) kvmalloc_array(SIR_IPI_TABLE_SIZE, sizeof(struct sir_ipi_slot), GFP_KERNEL);
+    entries = (struct sir_ipi_entry*) kvcalloc(num_entries > 0 ? num_entries : 1, sizeof(struct sir_ipi_entry), GFP_KERNEL);
+    symbol = (char*) kmalloc(KSYM_SYMBOL_LEN, GFP_KERNEL);
+    if(slots == NULL || entries == NULL || symbol == NULL){
+        rtn_val = -ENOMEM;
+        goto out;
+    }
+
+    //Copy the table so the symbols can be resolved without holding the lock
+    raw_spin_lock_irqsave(&(table->lock), irq_flags);
+    memcpy(slots, table->slots, SIR_IPI_TABLE_SIZE*sizeof(struct sir_ipi_slot));
+    generation = table->generation;
+    raw_spin_unlock_irqrestore(&(table->lock), irq_flags);
+
+    for(i = 0; i<SIR_IPI_TABLE_SIZE; i++){
+        struct sir_ipi_count count = slots[i].count;
+        struct sir_ipi_entry* entry;
+
+        if(!slots[i].in_use){
+            continue;
+        }
+        if(partial_state->ipi_baseline != NULL && partial_state->ipi_baseline[query.cpu].generation == generation){
+            struct sir_ipi_count* baseline = &(partial_state->ipi_baseline[query.cpu].counts[i]);
+            count.ipis -= baseline->ipis;
+            count.calls -= baseline->calls;
+        }
+        if(count.ipis == 0 && count.calls == 0){
+            continue;
+        }
+
+        total++;
+        if(written >= num_entries){
+            continue;
+        }
+
+        entry = &(entries[written]);
+        entry->src_cpu = slots[i].src_cpu;
+        entry->kind = slots[i].kind;
+        memcpy(entry->comm, slots[i].comm, SIR_IPI_COMM_LEN);
+        sprint_symbol_no_offset(symbol, slots[i].func);
+        strscpy(entry->symbol, symbol, SIR_IPI_SYM_LEN);
+        //TLB shootdowns are function calls to one of the flush_tlb functions.  The IPIs
+        //are only keyed by the function through csd_queue_cpu (see sir_ipi_call_func).
+        if(entry->kind == SIR_IPI_KIND_CALL && strncmp(symbol, "flush_tlb", 9) == 0){
+            entry->kind = SIR_IPI_KIND_TLB;
+        }
+        entry->ipis = count.ipis;
+        entry->calls = count.calls;
+        written++;
+    }
+
+    query.num_entries = written;
+    query.total_entries = total;
+    query.dropped = atomic64_read(&(table->dropped));
+
+    if(copy_to_user((void __user*) (uintptr_t) query.entries, entries, written*sizeof(struct sir_ipi_entry)) != 0 ||
+       copy_to_user(query_ptr, &query, sizeof(query)) != 0){
+        rtn_val = -EFAULT;
+    }
+
+    printkd(KERN_INFO "sir: ioctl ipi get (CPU %u): %u entries\n", query.cpu, written);
+
+out:
+    kfree(symbol);
+    kvfree(entries);
+    kvfree(slots);
+
+    return rtn_val;
+#else
+    return -ENODEV;
+#endif
+}
+
+//Records the current counts for a CPU (or all CPUs if the argument is -1) as the
+//baseline for SIR_IOCTL_IPI_GET on this file handle.
+//Expects partial_state->lock to be held.
+long sir_ipi_reset(struct partial_read_state* partial_state, unsigned long arg){
+#ifdef SIR_IPI
+    unsigned long irq_flags;
+    int target;
+    int cpu;
+    int i;
+
+    if(sir_ipi_tables == NULL){
+        return -ENODEV;
+    }
+
+    if(copy_from_user(&target, (int __user*) arg, sizeof(target)) != 0){
+        return -EFAULT;
+    }
+    if(target < -1 || target >= (int) nr_cpu_ids){
+        return -EINVAL;
+    }
+
+    if(partial_state->ipi_baseline == NULL){
+        partial_state->ipi_baseline = (struct sir_ipi_baseline*) kvcalloc(nr_cpu_ids, sizeof(struct sir_ipi_baseline), GFP_KERNEL);
+        if(partial_state->ipi_baseline == NULL){
+            return -ENOMEM;
+        }
+    }
+
+    for(cpu = 0; cpu<nr_cpu_ids; cpu++){
+        struct sir_ipi_table* table = &(sir_ipi_tables[cpu]);
+        struct sir_ipi_baseline* baseline = &(partial_state->ipi_baseline[cpu]);
+
+        if(target != -1 && cpu != target){
+            continue;
+        }
+
+        raw_spin_lock_irqsave(&(table->lock), irq_flags);
+        for(i = 0; i<SIR_IPI_TABLE_SIZE; i++){
+            baseline->counts[i] = table->slots[i].count;
+        }
+        baseline->generation = table->generation;
+        raw_spin_unlock_irqrestore(&(table->lock), irq_flags);
+    }
+
+    printkd(KERN_INFO "sir: ioctl ipi reset (CPU %d)\n", target);
+
+    return 0;
+#else
+    return -ENODEV;
+#endif
+}
+
+//Removes every entry from the table of a CPU (or all CPUs if the argument is -1) so
+//the slots can be reused by new sources.  This affects every file handle: baselines
+//taken before the clear are ignored by SIR_IOCTL_IPI_GET.
+long sir_ipi_clear(unsigned long arg){
+#ifdef SIR_IPI
+    unsigned long irq_flags;
+    int target;
+    int cpu;
+
+    if(sir_ipi_tables == NULL){
+        return -ENODEV;
+    }
+
+    if(copy_from_user(&target, (int __user*) arg, sizeof(target)) != 0){
+        return -EFAULT;
+    }
+    if(target < -1 || target >= (int) nr_cpu_ids){
+        return -EINVAL;
+    }
+
+    for(cpu = 0; cpu<nr_cpu_ids; cpu++){
+        struct sir_ipi_table* table = &(sir_ipi_tables[cpu]);
+
+        if(target != -1 && cpu != target){
+            continue;
+        }
+
+        raw_spin_lock_irqsave(&(table->lock), irq_flags);
+        memset(table->slots, 0, SIR_IPI_TABLE_SIZE*sizeof(struct sir_ipi_slot));
+        atomic64_set(&(table->dropped), 0);
+        table->generation++;
+        raw_spin_unlock_irqrestore(&(table->lock), irq_flags);
+    }
+
+    printkd(KERN_INFO "sir: ioctl ipi clear (CPU %d)\n", target);
+
+    return 0;
+#else
+    return -ENODEV;
+#endif
+}
+
+//==== Shared Sampling Sessions ====
+//Each session has one kernel thread which reads the counters of every online
+//CPU in the session once per period and appends the records to the ring.
+//Readers copy records out of the ring from their own cursor so the CPUs are
+//only read once per period no matter how many file handles are attached.
+//The sampling thread is created like any other kthread so, with isolcpus or
+//nohz_full, it runs on the housekeeping CPUs rather than the CPUs it samples.
+
+//Appends one record per online CPU in the session for the current period
+static void sir_session_sample(struct sir_session* session){
+    struct partial_read_state* reader;
+    u64 time_ns = ktime_get_ns();
+    int cpu;
+
+    spin_lock(&(session->ring_lock));
+    for_each_cpu_and(cpu, &(session->mask), cpu_online_mask){
+        char* entry = session->ring + (session->head & (session->capacity-1))*session->record_size;
+        struct sir_session_record* record = (struct sir_session_record*) entry;
+        SIR_INTERRUPT_TYPE* vals = (SIR_INTERRUPT_TYPE*) (entry + sizeof(struct sir_session_record));
+        unsigned int idx;
+
+        record->seq = session->seq;
+        record->time_ns = time_ns;
+        record->cpu = cpu;
+        record->num_fields = session->num_fields;
+        for(idx = 0; idx<SIR_PMU_EVENT_MAX; idx++){
+            if((session->fields >> idx) & 1){
+                *(vals++) = sir_counter_value(cpu, idx);
+            }
+        }
+        session->head++;
+    }
+    list_for_each_entry(reader, &(session->readers), session_node){
+        wake_up_interruptible(&(reader->session_wait));
+    }
+    spin_unlock(&(session->ring_lock));
+
+    session->seq++;
+}
+
+static int sir_session_thread(void* arg){
+    struct sir_session* session = (struct sir_session*) arg;
+    ktime_t next = ktime_get();
+
+    while(!kthread_should_stop()){
+        sir_session_sample(session);
+
+        //If the thread fell behind, skip the missed periods rather than
+        //sampling them back to back
+        next = ktime_add_ns(next, session->period_ns);
+        if(ktime_before(next, ktime_get())){
+            next = ktime_add_ns(ktime_get(), session->period_ns);
+        }
+
+        set_current_state(TASK_INTERRUPTIBLE);
+        if(kthread_should_stop()){
+            __set_current_state(TASK_RUNNING);
+            break;
+        }
+        schedule_hrtimeout(&next, HRTIMER_MODE_ABS);
+    }
+
+    return 0;
+}
+
+//Returns the session with the given name or NULL if it does not exist.
+//Expects sir_sessions_lock to be held.
+static struct sir_session* sir_session_find(const char* name){
+    int i;
+    for(i = 0; i<SIR_SESSION_MAX; i++){
+        if(sir_sessions[i] != NULL && strncmp(sir_sessions[i]->name, name, SIR_SESSION_NAME_LEN) == 0){
+            return sir_sessions[i];
+        }
+    }
+    return NULL;
+}
+
+//Copies the definition of a session back to userspace
+static void sir_session_fill_def(struct sir_session* session, struct sir_session_def* def){
+    int cpu;
+
+    def->fields = session->fields;
+    def->period_ns = session->period_ns;
+    def->periods = session->periods;
+    def->record_size = session->record_size;
+    memset(def->cpus, 0, sizeof(def->cpus));
+    for_each_cpu(cpu, &(session->mask)){
+        if(cpu < SIR_GROUP_MAX_CPUS){
+            def->cpus[cpu/64] |= 1ULL << (cpu%64);
+        }
+    }
+}
+
+#define SIR_SESSION_MAX_RING_BYTES (64UL << 20)
+
+//Creates a session and starts its sampling thread.
+//Expects sir_sessions_lock to be held.
+static struct sir_session* sir_session_create(struct sir_session_def* def, long* rtn_val){
+    struct sir_session* session;
+    unsigned int num_cpus;
+    int slot = -1;
+    int cpu;
+    int i;
+
+    for(i = 0; i<SIR_SESSION_MAX; i++){
+        if(sir_sessions[i] == NULL){
+            slot = i;
+            break;
+        }
+    }
+    if(slot < 0){
+        *rtn_val = -ENOSPC;
+        return NULL;
+    }
+
+    session = (struct sir_session*) kzalloc(sizeof(struct sir_session), GFP_KERNEL);
+    if(session == NULL){
+        *rtn_val = -ENOMEM;
+        return NULL;
+    }
+
+    for(cpu = 0; cpu<SIR_MIN(SIR_GROUP_MAX_CPUS, nr_cpu_ids); cpu++){
+        if((def->cpus[cpu/64] >> (cpu%64)) & 1){
+            cpumask_set_cpu(cpu, &(session->mask));
+        }
+    }
+    num_cpus = cpumask_weight(&(session->mask));
+
+    strscpy(session->name, def->name, SIR_SESSION_NAME_LEN);
+    session->fields = def->fields == 0 ? (1ULL << SIR_PMU_EVENT_IRQ_TOTAL)-1 : def->fields;
+    session->num_fields = hweight64(session->fields);
+    session->periods = def->periods == 0 ? SIR_SESSION_DEFAULT_PERIODS : def->periods;
+    session->period_ns = def->period_ns;
+    session->record_size = sizeof(struct sir_session_record) + session->num_fields*sizeof(SIR_INTERRUPT_TYPE);
+
+    if(num_cpus == 0 || session->period_ns < SIR_SESSION_MIN_PERIOD_NS ||
+       (session->fields >> SIR_PMU_EVENT_MAX) != 0 || (u64) session->periods*num_cpus > (1ULL << 24)){
+        kfree(session);
+        *rtn_val = -EINVAL;
+        return NULL;
+    }
+
+    session->capacity = roundup_pow_of_two((u64) session->periods*num_cpus);
+    if(session->capacity*session->record_size > SIR_SESSION_MAX_RING_BYTES){
+        kfree(session);
+        *rtn_val = -EINVAL;
+        return NULL;
+    }
+    session->ring = (char*) vmalloc(session->capacity*session->record_size);
+    if(session->ring == NULL){
+        kfree(session);
+        *rtn_val = -ENOMEM;
+        return NULL;
+    }
+
+    spin_lock_init(&(session->ring_lock));
+    INIT_LIST_HEAD(&(session->readers));
+
+    session->thread = kthread_run(sir_session_thread, session, "sir_session/%s", session->name);
+    if(IS_ERR(session->thread)){
+        *rtn_val = PTR_ERR(session->thread);
+        vfree(session->ring);
+        kfree(session);
+        return NULL;
+    }
+
+    sir_sessions[slot] = session;
+    printkd(KERN_INFO "sir: Created session %s (%u CPUs, %u fields, %llu ns)\n", session->name, num_cpus, session->num_fields, session->period_ns);
+
+    return session;
+}
+
+//Attaches this file handle to a session, creating it if it does not exist.
+//Reading starts from the next record captured.
+//Expects partial_state->lock to be held.
+long sir_session_attach(struct partial_read_state* partial_state, unsigned long arg){
+    struct sir_session_def* def;
+    struct sir_session* session;
+    long rtn_val = 0;
+
+    if(partial_state->session != NULL){
+        return -EBUSY;
+    }
+
+    //The definition is too large to keep on the kernel stack
+    def = (struct sir_session_def*) kmalloc(sizeof(struct sir_session_def), GFP_KERNEL);
+    if(def == NULL){
+        return -ENOMEM;
+    }
+
+    if(copy_from_user(def, (void __user*) arg, sizeof(struct sir_session_def)) != 0){
+        rtn_val = -EFAULT;
+        goto out;
+    }
+    def->name[SIR_SESSION_NAME_LEN-1] = '\0';
+    if(def->name[0] == '\0'){
+        rtn_val = -EINVAL;
+        goto out;
+    }
+
+    mutex_lock(&sir_sessions_lock);
+    session = sir_session_find(def->name);
+    if(session == NULL){
+        session = sir_session_create(def, &rtn_val);
+    }
+    if(session != NULL){
+        session->refs++;
+        partial_state->session = session;
+        spin_lock(&(session->ring_lock));
+        partial_state->session_cursor = session->head;
+        list_add_tail(&(partial_state->session_node), &(session->readers));
+        spin_unlock(&(session->ring_lock));
+        sir_session_fill_def(session, def);
+    }
+    mutex_unlock(&sir_sessions_lock);
+
+    //The caller cannot tell it is attached if the definition cannot be returned
+    if(rtn_val == 0 && copy_to_user((void __user*) arg, def, sizeof(struct sir_session_def)) != 0){
+        sir_session_detach(partial_state);
+        rtn_val = -EFAULT;
+    }
+
+out:
+    kfree(def);
+
+    return rtn_val;
+}
+
+//Drops a reference to a session.  The sampling thread is stopped and the
+//session is freed when the last reference is dropped.
+static void sir_session_put(struct sir_session* session){
+    int i;
+
+    mutex_lock(&sir_sessions_lock);
+    session->refs--;
+    if(session->refs > 0){
+        mutex_unlock(&sir_sessions_lock);
+        return;
+    }
+    for(i = 0; i<SIR_SESSION_MAX; i++){
+        if(sir_sessions[i] == session){
+            sir_sessions[i] = NULL;
+        }
+    }
+    mutex_unlock(&sir_sessions_lock);
+
+    kthread_stop(session->thread);
+    printkd(KERN_INFO "sir: Stopped session %s\n", session->name);
+    vfree(session->ring);
+    kfree(session);
+}
+
+//Detaches this file handle from its session.  Reads waiting on the file handle
+//are woken and return -ENOENT.
+//Expects partial_state->lock to be held (or the file to be being released).
+long sir_session_detach(struct partial_read_state* partial_state){
+    struct sir_session* session = partial_state->session;
+
+    if(session == NULL){
+        return -ENOENT;
+    }
+    WRITE_ONCE(partial_state->session, NULL);
+
+    spin_lock(&(session->ring_lock));
+    list_del_init(&(partial_state->session_node));
+    spin_unlock(&(session->ring_lock));
+    wake_up_interruptible(&(partial_state->session_wait));
+
+    sir_session_put(session);
+
+    return 0;
+}
+
+#define SIR_SESSION_READ_CHUNK 64 //Records copied per acquisition of the ring lock
+
+//Copies the records after this file handle's cursor to userspace.  Records which
+//were overwritten before being read are skipped and reported in lost.  The ring
+//is copied in chunks so the sampling thread is never held off for long.
+//Expects partial_state->lock to be held.  It is dropped while waiting for records.
+long sir_session_read(struct partial_read_state* partial_state, unsigned long arg){
+    struct sir_session_read __user* read_ptr = (struct sir_session_read __user*) arg;
+    struct sir_session_read read;
+    struct sir_session* session = partial_state->session;
+    char* chunk;
+    char __user* dst;
+    u32 written = 0;
+    u64 lost = 0;
+    long rtn_val = 0;
+
+    if(session == NULL){
+        return -ENOENT;
+    }
+
+    if(copy_from_user(&read, read_ptr, sizeof(read)) != 0){
+        return -EFAULT;
+    }
+    dst = (char __user*) (uintptr_t) read.buf;
+
+    //The file handle can be detached (or read) by another thread while this one
+    //waits.  The reference keeps the session alive until the lock is retaken.
+    if(read.flags & SIR_SESSION_READ_WAIT){
+        int wait_rtn;
+
+        mutex_lock(&sir_sessions_lock);
+        session->refs++;
+        mutex_unlock(&sir_sessions_lock);
+        mutex_unlock(&(partial_state->lock));
+
+        wait_rtn = wait_event_interruptible(partial_state->session_wait,
+                                            READ_ONCE(partial_state->session) != session ||
+                                            READ_ONCE(session->head) != READ_ONCE(partial_state->session_cursor));
+
+        sir_lock_state(partial_state);
+        sir_session_put(session);
+        if(wait_rtn != 0){
+            return -EINTR;
+        }
+        if(partial_state->session != session){
+            return -ENOENT;
+        }
+    }
+
+    chunk = (char*) kmalloc(SIR_SESSION_READ_CHUNK*session->record_size, GFP_KERNEL);
+    if(chunk == NULL){
+        return -ENOMEM;
+    }
+
+    while(written < read.max_records){
+        u64 cursor = partial_state->session_cursor;
+        u64 available;
+        u32 num;
+        u32 i;
+
+        spin_lock(&(session->ring_lock));
+        if(session->head - cursor > session->capacity){
+            lost += session->head - session->capacity - cursor;
+            cursor = session->head - session->capacity;
+        }
+        available = session->head - cursor;
+        num = (u32) SIR_MIN(available, (u64) SIR_MIN(read.max_records - written, SIR_SESSION_READ_CHUNK));
+        for(i = 0; i<num; i++){
+            memcpy(chunk + i*session->record_size,
+                   session->ring + ((cursor+i) & (session->capacity-1))*session->record_size,
+                   session->record_size);
+        }
+        spin_unlock(&(session->ring_lock));
+
+        partial_state->session_cursor = cursor + num;
+        if(num == 0){
+            break;
+        }
+
+        if(copy_to_user(dst + (size_t) written*session->record_size, chunk, (size_t) num*session->record_size) != 0){
+            rtn_val = -EFAULT;
+            break;
+        }
+        written += num;
+    }
+
+    kfree(chunk);
+
+    read.num_records = written;
+    read.record_size = session->record_size;
+    read.lost = lost;
+    if(rtn_val == 0 && copy_to_user(read_ptr, &read, sizeof(read)) != 0){
+        rtn_val = -EFAULT;
+    }
+
+    printkd(KERN_INFO "sir: ioctl session read %s: %u records, %llu lost\n", session->name, written, lost);
+
+    return rtn_val;
+}
+
+//Reports POLLIN when the session this file handle is attached to has records
+//which have not been read.  A file handle which is not attached is never readable.
+__poll_t sir_poll(struct file *filp, struct poll_table_struct *wait){
+    struct partial_read_state* partial_state = (struct partial_read_state*) filp->private_data;
+    struct sir_session* session;
+    __poll_t mask = 0;
+
+    poll_wait(filp, &(partial_state->session_wait), wait);
+
+    mutex_lock(&(partial_state->lock));
+    session = partial_state->session;
+    if(session != NULL){
+        if(READ_ONCE(session->head) != partial_state->session_cursor){
+            mask = EPOLLIN | EPOLLRDNORM;
+        }
+    }
+    mutex_unlock(&(partial_state->lock));
+
+    return mask;
+}
+
+#ifdef SIR_URING_CMD
+//==== io_uring Commands ====
+
+//Writes part of a uring_cmd result.  Results must be written in order
+//since registered buffers are accessed through an iov_iter.
+static int sir_uring_write(int fixed, struct iov_iter* iter, void __user* dst, size_t offset, const void* src, size_t len){
+    if(fixed){
+        return copy_to_iter(src, len, iter) == len ? 0 : -EFAULT;
+    }
+    return copy_to_user(dst + offset, src, len) == 0 ? 0 : -EFAULT;
+}
+
+//Allows the counters to be sampled as part of an io_uring submission batch
+//instead of with a separate ioctl call.  See sir.h for the command format.
+//The command completes synchronously so the result is returned directly.
+int sir_uring_cmd(struct io_uring_cmd *ioucmd, unsigned int issue_flags)
+{
+    struct partial_read_state* partial_state = (struct partial_read_state*) ioucmd->file->private_data;
+    struct sir_uring_cmd cmd;
+    struct iov_iter iter;
+    void __user* dst;
+    int fixed = (ioucmd->flags & IORING_URING_CMD_FIXED) != 0;
+    int rtn_val = -EINVAL;
+    int cpu;
+    int stat_op = SIR_STAT_OTHER;
+    u64 stats_start = sir_stats_start();
+
+    //The SQE is shared with userspace so the command is copied once before use
+    #if LINUX_VERSION_CODE >= KERNEL_VERSION(6,5,0)
+        memcpy(&cmd, io_uring_sqe_cmd(ioucmd->sqe), sizeof(cmd));
+    #else
+        memcpy(&cmd, ioucmd->cmd, sizeof(cmd));
+    #endif
+    dst = u64_to_user_ptr(cmd.addr);
+
+    if(fixed){
+        #if LINUX_VERSION_CODE >= KERNEL_VERSION(6,15,0)
+            rtn_val = io_uring_cmd_import_fixed(cmd.addr, cmd.len, ITER_DEST, &iter, ioucmd, issue_flags);
+        #else
+            rtn_val = io_uring_cmd_import_fixed(cmd.addr, cmd.len, ITER_DEST, &iter, ioucmd);
+        #endif
+        if(rtn_val < 0){
+            return rtn_val;
+        }
+    }
+
+    printkd(KERN_INFO "sir: uring_cmd op: %x len: %u fixed: %d\n", ioucmd->cmd_op, cmd.len, fixed);
+
+    //When issued inline from io_uring_enter, blocking is not allowed.  If another
+    //user of this file holds the lock, io_uring retries the command from a worker.
+    if(issue_flags & IO_URING_F_NONBLOCK){
+        if(!mutex_trylock(&(partial_state->lock))){
+            sir_stats_inc(lock_contended);
+            return -EAGAIN;
+        }
+    }else{
+        sir_lock_state(partial_state);
+    }
+
+    if(ioucmd->cmd_op == SIR_IOCTL_GET){
+        SIR_INTERRUPT_TYPE irq_sum;
+        stat_op = SIR_STAT_URING_GET;
+
+        if(cmd.len >= sizeof(irq_sum)){
+            cpu = get_cpu();
+            sir_snapshot_total(cpu, partial_state);
+            put_cpu();
+
+            irq_sum = partial_state->irq_std + partial_state->arch_irq_stat_sum;
+            rtn_val = sir_uring_write(fixed, &iter, dst, 0, &irq_sum, sizeof(irq_sum));
+            if(rtn_val == 0){
+                rtn_val = sizeof(irq_sum);
+            }
+        }
+    } else if(ioucmd->cmd_op == SIR_IOCTL_GET_DETAILED){
+        struct sir_report report;
+        stat_op = SIR_STAT_URING_GET_DETAILED;
+
+        if(cmd.len >= sizeof(report)){
+            cpu = get_cpu();
+            sir_snapshot_detailed(cpu, partial_state);
+            put_cpu();
+
+            copy_interrupt_report(partial_state, &report);
+            rtn_val = sir_uring_write(fixed, &iter, dst, 0, &report, sizeof(report));
+            if(rtn_val == 0){
+                rtn_val = sizeof(report);
+            }
+        }
+    } else if(ioucmd->cmd_op == SIR_IOCTL_GET_ALL){
+        struct sir_report report;
+        unsigned int num_reports = SIR_MIN(cmd.len/sizeof(report), nr_cpu_ids);
+        stat_op = SIR_STAT_URING_GET_ALL;
+
+        //Unlike sir_get_all, the hotplug lock is not taken since the user copy
+        //can fault.  The per-CPU counters of every possible CPU remain valid so a
+        //CPU going offline while being read only results in a stale report.
+        rtn_val = 0;
+        for(cpu = 0; cpu<num_reports && rtn_val == 0; cpu++){
+            if(cpu_online(cpu)){
+                get_interrupts(cpu, partial_state);
+                copy_interrupt_report(partial_state, &report);
+            }else{
+                memset(&report, 0, sizeof(report));
+            }
+            rtn_val = sir_uring_write(fixed, &iter, dst, cpu*sizeof(report), &report, sizeof(report));
+        }
+        if(rtn_val == 0){
+            rtn_val = num_reports*sizeof(report);
+        }
+    } else {
+        rtn_val = -ENOTTY;
+    }
+
+    mutex_unlock(&(partial_state->lock));
+
+    sir_stats_end(stat_op, stats_start);
+
+    return rtn_val;
+}
+#endif
+
+#ifdef SIR_PMU
+//==== perf PMU ====
+//Exposes the counters as perf events so they can be read with perf stat or
+//in a PERF_FORMAT_GROUP read alongside hardware events.  The counters are
+//free running so, like the msr PMU (arch/x86/events/msr.c), each event records
+//the counter value when it is started and accumulates the change when it is
+//stopped or read.  Per-task events are started and stopped as the task is
+//scheduled in and out so only interrupts which land while the task is
+//running are counted.
+
+PMU_FORMAT_ATTR(event, "config:0-7");
+
+static struct attribute *sir_pmu_format_attrs[] = {
+    &format_attr_event.attr,
+    NULL,
+};
+
+static struct attribute_group sir_pmu_format_group = {
+    .name = "format",
+    .attrs = sir_pmu_format_attrs,
+};
+
+//Event names are the /proc/interrupts abbreviations for the x86 interrupts
+#define SIR_PMU_EVENT_ATTR(name, idx) PMU_EVENT_ATTR_STRING(name, sir_pmu_attr_##name, "event=" #idx)
+SIR_PMU_EVENT_ATTR(std, 0);
+SIR_PMU_EVENT_ATTR(nmi, 1);
+SIR_PMU_EVENT_ATTR(loc, 2);
+SIR_PMU_EVENT_ATTR(spu, 3);
+SIR_PMU_EVENT_ATTR(pmi, 4);
+SIR_PMU_EVENT_ATTR(iwi, 5);
+SIR_PMU_EVENT_ATTR(rtr, 6);
+SIR_PMU_EVENT_ATTR(plt, 7);
+SIR_PMU_EVENT_ATTR(res, 8);
+SIR_PMU_EVENT_ATTR(cal, 9);
+SIR_PMU_EVENT_ATTR(tlb, 10);
+SIR_PMU_EVENT_ATTR(trm, 11);
+SIR_PMU_EVENT_ATTR(thr, 12);
+SIR_PMU_EVENT_ATTR(dfr, 13);
+SIR_PMU_EVENT_ATTR(mce, 14);
+SIR_PMU_EVENT_ATTR(mcp, 15);
+SIR_PMU_EVENT_ATTR(hyp, 16);
+SIR_PMU_EVENT_ATTR(pin, 17);
+SIR_PMU_EVENT_ATTR(npi, 18);
+SIR_PMU_EVENT_ATTR(piw, 19);
+SIR_PMU_EVENT_ATTR(arch_sum, 20);
+SIR_PMU_EVENT_ATTR(softirq_hi, 21);
+SIR_PMU_EVENT_ATTR(softirq_timer, 22);
+SIR_PMU_EVENT_ATTR(softirq_net_tx, 23);
+SIR_PMU_EVENT_ATTR(softirq_net_rx, 24);
+SIR_PMU_EVENT_ATTR(softirq_block, 25);
+SIR_PMU_EVENT_ATTR(softirq_irq_poll, 26);
+SIR_PMU_EVENT_ATTR(softirq_tasklet, 27);
+SIR_PMU_EVENT_ATTR(softirq_sched, 28);
+SIR_PMU_EVENT_ATTR(softirq_hrtimer, 29);
+SIR_PMU_EVENT_ATTR(softirq_rcu, 30);
+SIR_PMU_EVENT_ATTR(softirq_other, 31);
+SIR_PMU_EVENT_ATTR(irq_total, 32);
+SIR_PMU_EVENT_ATTR(softirq_total, 33);
+
+static struct attribute *sir_pmu_events_attrs[] = {
+    &sir_pmu_attr_std.attr.attr,
+    &sir_pmu_attr_nmi.attr.attr,
+    &sir_pmu_attr_loc.attr.attr,
+    &sir_pmu_attr_spu.attr.attr,
+    &sir_pmu_attr_pmi.attr.attr,
+    &sir_pmu_attr_iwi.attr.attr,
+    &sir_pmu_attr_rtr.attr.attr,
+    &sir_pmu_attr_plt.attr.attr,
+    &sir_pmu_attr_res.attr.attr,
+    &sir_pmu_attr_cal.attr.attr,
+    &sir_pmu_attr_tlb.attr.attr,
+    &sir_pmu_attr_trm.attr.attr,
+    &sir_pmu_attr_thr.attr.attr,
+    &sir_pmu_attr_dfr.attr.attr,
+    &sir_pmu_attr_mce.attr.attr,
+    &sir_pmu_attr_mcp.attr.attr,
+    &sir_pmu_attr_hyp.attr.attr,
+    &sir_pmu_attr_pin.attr.attr,
+    &sir_pmu_attr_npi.attr.attr,
+    &sir_pmu_attr_piw.attr.attr,
+    &sir_pmu_attr_arch_sum.attr.attr,
+    &sir_pmu_attr_softirq_hi.attr.attr,
+    &sir_pmu_attr_softirq_timer.attr.attr,
+    &sir_pmu_attr_softirq_net_tx.attr.attr,
+    &sir_pmu_attr_softirq_net_rx.attr.attr,
+    &sir_pmu_attr_softirq_block.attr.attr,
+    &sir_pmu_attr_softirq_irq_poll.attr.attr,
+    &sir_pmu_attr_softirq_tasklet.attr.attr,
+    &sir_pmu_attr_softirq_sched.attr.attr,
+    &sir_pmu_attr_softirq_hrtimer.attr.attr,
+    &sir_pmu_attr_softirq_rcu.attr.attr,
+    &sir_pmu_attr_softirq_other.attr.attr,
+    &sir_pmu_attr_irq_total.attr.attr,
+    &sir_pmu_attr_softirq_total.attr.attr,
+    NULL,
+};
+
+static struct attribute_group sir_pmu_events_group = {
+    .name = "events",
+    .attrs = sir_pmu_events_attrs,
+};
+
+static const struct attribute_group *sir_pmu_attr_groups[] = {
+    &sir_pmu_format_group,
+    &sir_pmu_events_group,
+    NULL,
+};
+
+static int sir_pmu_event_init(struct perf_event *event)
+{
+    u64 cfg = event->attr.config;
+
+    if(event->attr.type != event->pmu->type){
+        return -ENOENT;
+    }
+
+    //The counters are read, they do not generate overflow interrupts
+    if(is_sampling_event(event)){
+        return -EINVAL;
+    }
+
+    if(cfg >= SIR_PMU_EVENT_MAX){
+        return -EINVAL;
+    }
+
+    event->hw.idx = -1;
+    event->hw.config = cfg;
+    //Shift used to compute the change in 32 bit counters across a wrap
+    event->hw.config_base = sir_counter_is_32bit(cfg) ? 32 : 0;
+
+    return 0;
+}
+
+static void sir_pmu_event_update(struct perf_event *event)
+{
+    int shift = event->hw.config_base;
+    u64 prev;
+    u64 now;
+    s64 delta;
+
+    //An NMI (ex. a hardware event overflow reading the group) can update prev_count
+again:
+    prev = local64_read(&event->hw.prev_count);
+    now = sir_counter_value(smp_processor_id(), event->hw.config);
+    if(local64_cmpxchg(&event->hw.prev_count, prev, now) != prev){
+        goto again;
+    }
+
+    delta = (now << shift) - (prev << shift);
+    delta >>= shift;
+    //irq_total is irq_std (64 bits) plus the 32 bit x86 counters, each of which
+    //drops the total by 2^32 when it wraps
+    if(event->hw.config == SIR_PMU_EVENT_IRQ_TOTAL){
+        while(delta < 0){
+            delta += 1LL << 32;
+        }
+    }
+    local64_add(delta, &event->count);
+}
+
+static void sir_pmu_event_start(struct perf_event *event, int flags)
+{
+    local64_set(&event->hw.prev_count, sir_counter_value(smp_processor_id(), event->hw.config));
+}
+
+static void sir_pmu_event_stop(struct perf_event *event, int flags)
+{
+    sir_pmu_event_update(event);
+}
+
+static void sir_pmu_event_del(struct perf_event *event, int flags)
+{
+    sir_pmu_event_stop(event, PERF_EF_UPDATE);
+}
+
+static int sir_pmu_event_add(struct perf_event *event, int flags)
+{
+    if(flags & PERF_EF_START){
+        sir_pmu_event_start(event, flags);
+    }
+    return 0;
+}
+
+static struct pmu sir_pmu = {
+    .module       = THIS_MODULE,
+    .task_ctx_nr  = perf_sw_context,
+    .attr_groups  = sir_pmu_attr_groups,
+    .event_init   = sir_pmu_event_init,
+    .add          = sir_pmu_event_add,
+    .del          = sir_pmu_event_del,
+    .start        = sir_pmu_event_start,
+    .stop         = sir_pmu_event_stop,
+    .read         = sir_pmu_event_update,
+    #ifdef PERF_PMU_CAP_NO_EXCLUDE
+    .capabilities = PERF_PMU_CAP_NO_INTERRUPT | PERF_PMU_CAP_NO_EXCLUDE,
+    #else
+    .capabilities = PERF_PMU_CAP_NO_INTERRUPT,
+    #endif
+};
+
+int sir_pmu_registered = 0;
+#endif
+
+#ifdef SIR_BPF
+//==== BPF kfuncs ====
+//Lets tracing programs (fentry/fexit, tp_btf) read the counters without a
+//round trip to userspace.  The declarations for BPF programs are in sir_bpf.h.
+//cpu < 0 selects the CPU the program is running on.  Tracing programs run
+//with migration disabled so the CPU does not change during the call.
+
+static int sir_bpf_cpu(int cpu){
+    if(cpu < 0){
+        return smp_processor_id();
+    }
+    if(cpu >= nr_cpu_ids || !cpu_possible(cpu)){
+        return -EINVAL;
+    }
+    return cpu;
+}
+
+__bpf_kfunc_start_defs();
+
+//Fills buf with the struct sir_report for the CPU.  Only the first buf__sz bytes
+//are written if the buffer is smaller than the report.  Returns the number of
+//bytes written or -EINVAL.  Reads of the current CPU are taken with interrupts
+//disabled, reads of other CPUs are not atomic (same as SIR_IOCTL_GET_ALL).
+__bpf_kfunc int bpf_sir_get_report(int cpu, void *buf, u32 buf__sz){
+    SIR_INTERRUPT_TYPE* vals = (SIR_INTERRUPT_TYPE*) buf;
+    unsigned int num_fields = SIR_MIN(buf__sz, sizeof(struct sir_report))/sizeof(SIR_INTERRUPT_TYPE);
+    unsigned long irq_flags;
+    unsigned int i;
+    int local;
+
+    cpu = sir_bpf_cpu(cpu);
+    if(cpu < 0){
+        return cpu;
+    }
+
+    local = cpu == smp_processor_id();
+    if(local){
+        local_irq_save(irq_flags);
+    }
+    for(i = 0; i<num_fields; i++){
+        vals[i] = sir_counter_value(cpu, i);
+    }
+    if(local){
+        local_irq_restore(irq_flags);
+    }
+
+    return num_fields*sizeof(SIR_INTERRUPT_TYPE);
+}
+
+//Reads a single counter.  idx is the index of the field in struct sir_report or
+//one of the SIR_PMU_EVENT totals (the same numbering as the perf events).
+//Returns 0 or -EINVAL.
+__bpf_kfunc int bpf_sir_get_counter(int cpu, u32 idx, u64 *value){
+    cpu = sir_bpf_cpu(cpu);
+    if(cpu < 0){
+        return cpu;
+    }
+    if(idx >= SIR_PMU_EVENT_MAX){
+        return -EINVAL;
+    }
+
+    *value = sir_counter_value(cpu, idx);
+    return 0;
+}
+
+__bpf_kfunc_end_defs();
+
+BTF_KFUNCS_START(sir_kfunc_ids)
+BTF_ID_FLAGS(func, bpf_sir_get_report)
+BTF_ID_FLAGS(func, bpf_sir_get_counter)
+BTF_KFUNCS_END(sir_kfunc_ids)
+
+static const struct btf_kfunc_id_set sir_kfunc_set = {
+    .owner = THIS_MODULE,
+    .set   = &sir_kfunc_ids,
+};
+#endif
+
+// ==== Init / Cleanup Functions ====
+static void sir_cleanup(void)
+{
+    #ifdef SIR_STATS
+        debugfs_remove_recursive(sir_debugfs_dir);
+        sir_debugfs_dir = NULL;
+    #endif
+
+    #ifdef SIR_IPI
+        if(sir_ipi_tables != NULL){
+            sir_ipi_stop();
+        }
+    #endif
+
+    #ifdef SIR_TICK
+        if(sir_tick_tracked){
+            sir_tracepoints_unregister(sir_tick_tracepoints);
+            tracepoint_synchronize_unregister();
+            sir_tick_tracked = 0;
+        }
+    #endif
+
+    #ifdef SIR_PMU
+        if(sir_pmu_registered){
+            perf_pmu_unregister(&sir_pmu);
+            sir_pmu_registered = 0;
+            printkd(KERN_INFO "sir: Unregistered PMU\n");
+        }
+    #endif
+
+    if(cdevp != NULL){
+        cdev_del(cdevp);
+        printkd(KERN_INFO "sir: Unregistered sir0\n");
+    }
+
+    if(sir_major >= 0){
+        unregister_chrdev_region(dev, 1);
+        printkd(KERN_INFO "sir: Unregistered Region\n");
+    }
+}
+
+//Resolves the address of a kernel symbol which is not exported.
+//Returns 0 if the symbol cannot be found.
+//kallsyms_lookup_name is not exported as of 5.7.  On those kernels, its
+//address is found once with a kprobe (which resolves symbol names internally).
+//Thanks for the pointer https://stackoverflow.com/questions/40431194/how-do-i-access-any-kernel-symbol-in-a-kernel-module
+static unsigned long sir_lookup_symbol(const char* name)
+{
+    #if LINUX_VERSION_CODE >= KERNEL_VERSION(5,7,0)
+        #ifdef CONFIG_KPROBES
+            static unsigned long (*kallsyms_lookup_name_local)(const char* name) = NULL;
+            if(kallsyms_lookup_name_local == NULL){
+                struct kprobe kp = {.symbol_name = "kallsyms_lookup_name"};
+                if(register_kprobe(&kp) < 0){
+                    return 0;
+                }
+                kallsyms_lookup_name_local = (typeof(kallsyms_lookup_name_local)) kp.addr;
+                unregister_kprobe(&kp);
+            }
+            return kallsyms_lookup_name_local(name);
+        #else
+            return 0;
+        #endif
+    #else
+        return kallsyms_lookup_name(name);
+    #endif
+}
+
+static int sir_init(void)
+{
+    int status;
+
+    #if !(CONFIG_X86)
+        printk(KERN_WARNING "sir: This module only supports x86");
+        sir_cleanup();
+        return -EFAULT;
+    #endif
+
+    //Get the softirq entries
+    status = find_softirq_indexes();
+    if(status != 0){
+        sir_cleanup();
+        return -EFAULT;
+    }
+
+    //Resolve the unexported MCE counters.  These are optional.
+    #ifdef CONFIG_X86_MCE
+        mce_exception_count_local = (unsigned int __percpu*) sir_lookup_symbol("mce_exception_count");
+        mce_poll_count_local = (unsigned int __percpu*) sir_lookup_symbol("mce_poll_count");
+        if(mce_exception_count_local == NULL || mce_poll_count_local == NULL){
+            printk(KERN_INFO "sir: Unable to find the MCE counters, MCE and MCP will be reported as 0\n");
+            mce_exception_count_local = NULL;
+            mce_poll_count_local = NULL;
+        }
+    #endif
+
+    //Resolve the unexported tick state.  This is optional.
+    #ifdef SIR_TICK
+        tick_nohz_tick_stopped_cpu_local = (bool (*)(int)) sir_lookup_symbol("tick_nohz_tick_stopped_cpu");
+        tick_cpu_device_local = (struct clock_event_device* __percpu*) sir_lookup_symbol("tick_cpu_device");
+        if(tick_nohz_tick_stopped_cpu_local == NULL || tick_cpu_device_local == NULL){
+            printk(KERN_INFO "sir: Unable to find the tick state, the tick stopped state or next event will not be reported\n");
+        }
+    #endif
+
+    //**** Create Device ****
+    status = alloc_chrdev_region(&dev, 0, 1, "sir");
+    if(status < 0){
+        //Error Allocating Device
+        sir_cleanup();
+        return -ENOMEM;
+    }
+
+    sir_major = MAJOR(dev);
+    sir_minor = MINOR(dev);
+    
+    printkd(KERN_INFO "sir: Dev Number - Major: %d, Minor: %d\n", sir_major, sir_minor);
+
+    //**** Create and Register Char Dev ****
     cdevp = cdev_alloc();
     if(cdevp == NULL){
         //Error Allocating Char Dev
@@ -653,6 +2710,64 @@ static int sir_init(void)
     }
     printk(KERN_INFO "sir: Registered sir0\n");
 
+    //**** Register perf PMU ****
+    //The char device is still usable if the PMU cannot be registered
+    #ifdef SIR_PMU
+        status = perf_pmu_register(&sir_pmu, "sir", -1);
+        if(status < 0){
+            printk(KERN_WARNING "sir: Unable to register PMU: %d\n", status);
+        }else{
+            sir_pmu_registered = 1;
+            printk(KERN_INFO "sir: Registered PMU\n");
+        }
+    #endif
+
+    //**** Create debugfs Entries ****
+    #ifdef SIR_STATS
+        sir_debugfs_dir = debugfs_create_dir("sir", NULL);
+        debugfs_create_file("stats", 0600, sir_debugfs_dir, NULL, &sir_stats_fops);
+    #endif
+
+    //**** Start Tick Diagnostics ****
+    if(tick_tracking){
+        #ifdef SIR_TICK
+            status = sir_tracepoints_register(sir_tick_tracepoints);
+            if(status < 0){
+                printk(KERN_WARNING "sir: Unable to track tick stops: %d\n", status);
+            }else{
+                sir_tick_tracked = 1;
+            }
+        #else
+            printk(KERN_WARNING "sir: Tick tracking requires kernel 4.6 or later with CONFIG_NO_HZ_COMMON and CONFIG_TRACEPOINTS\n");
+        #endif
+    }
+
+    //**** Start IPI Attribution ****
+    //The rest of the module is still usable if the tracepoints cannot be attached
+    if(ipi_attribution){
+        #ifdef SIR_IPI
+            status = sir_ipi_start();
+            if(status < 0){
+                printk(KERN_WARNING "sir: Unable to start IPI attribution: %d\n", status);
+            }else{
+                printk(KERN_INFO "sir: Started IPI attribution\n");
+            }
+        #else
+            printk(KERN_WARNING "sir: IPI attribution requires kernel 6.5 or later with CONFIG_TRACEPOINTS\n");
+        #endif
+    }
+
+    //**** Register BPF kfuncs ****
+    //The kfuncs are removed by the BPF subsystem when the module is unloaded
+    #ifdef SIR_BPF
+        status = register_btf_kfunc_id_set(BPF_PROG_TYPE_TRACING, &sir_kfunc_set);
+        if(status < 0){
+            printk(KERN_WARNING "sir: Unable to register BPF kfuncs: %d\n", status);
+        }else{
+            printk(KERN_INFO "sir: Registered BPF kfuncs\n");
+        }
+    #endif
+
     printk(KERN_INFO "sir: Startup Complete\n");
     return 0;
 
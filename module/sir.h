@@ -9,6 +9,17 @@
 #define SIR_IOCTL_GET_DETAILED _IOR(SIR_IOCTL_MAGIC, 1, long)
 #define SIR_IOCTL_DISABLE_INTERRUPT _IOR(SIR_IOCTL_MAGIC, 2, long)
 #define SIR_IOCTL_RESTORE_INTERRUPT _IOR(SIR_IOCTL_MAGIC, 3, long)
+#define SIR_IOCTL_GET_ALL _IOWR(SIR_IOCTL_MAGIC, 4, struct sir_batch)
+#define SIR_IOCTL_GROUP_ADD _IOW(SIR_IOCTL_MAGIC, 5, struct sir_group_def)
+#define SIR_IOCTL_GROUP_REMOVE _IOW(SIR_IOCTL_MAGIC, 6, struct sir_group_def)
+#define SIR_IOCTL_GROUP_GET _IOWR(SIR_IOCTL_MAGIC, 7, struct sir_group_report)
+#define SIR_IOCTL_IPI_GET _IOWR(SIR_IOCTL_MAGIC, 8, struct sir_ipi_query)
+#define SIR_IOCTL_IPI_RESET _IOW(SIR_IOCTL_MAGIC, 9, int)
+#define SIR_IOCTL_GET_ALL_TICK _IOWR(SIR_IOCTL_MAGIC, 10, struct sir_batch)
+#define SIR_IOCTL_SESSION_ATTACH _IOWR(SIR_IOCTL_MAGIC, 11, struct sir_session_def)
+#define SIR_IOCTL_SESSION_DETACH _IO(SIR_IOCTL_MAGIC, 12)
+#define SIR_IOCTL_SESSION_READ _IOWR(SIR_IOCTL_MAGIC, 13, struct sir_session_read)
+#define SIR_IOCTL_IPI_CLEAR _IOW(SIR_IOCTL_MAGIC, 14, int)
 
 #define SIR_INTERRUPT_TYPE uint64_t
 
@@ -35,8 +46,8 @@ struct sir_report{
         SIR_INTERRUPT_TYPE irq_npi;       //NPI: Nested posted-interrupt event       (kvm_posted_intr_nested_ipis)
         SIR_INTERRUPT_TYPE irq_piw;       //PIW: Posted-interrupt wakeup event       (kvm_posted_intr_wakeup_ipis)
 
-        SIR_INTERRUPT_TYPE arch_irq_stat_sum; //This is the sum of the above interrupts but is gathered using arch_irq_stat_cpu(unsigned int cpu)
-                                              //This is collected because some variables are not exported but are read by this function
+        SIR_INTERRUPT_TYPE arch_irq_stat_sum; //This is the sum of the x86 specific interrupts computed the same way as arch_irq_stat_cpu(unsigned int cpu)
+                                              //in arch/x86/kernel/irq.c (which excludes TLB since TLB shootdowns are counted in CAL)
 
         SIR_INTERRUPT_TYPE softirq_hi;
         SIR_INTERRUPT_TYPE softirq_timer;
@@ -51,4 +62,201 @@ struct sir_report{
         SIR_INTERRUPT_TYPE softirq_other; //Other softirqs that are not one of the above
 };
 
-#endif
\ No newline at end of file
+//Argument for SIR_IOCTL_GET_ALL
+//Collects the sir_report for every CPU in a single call.  reports[i] is
+//the report for CPU i.  Entries for offline CPUs are zeroed.
+struct sir_batch{
+        uint32_t num_reports; //In: number of entries in reports, Out: number of entries written
+        uint32_t num_cpus;    //Out: number of possible CPUs (nr_cpu_ids)
+        uint64_t reports;     //Userspace pointer to an array of struct sir_report
+};
+
+//nohz Tick Diagnostics
+//SIR_IOCTL_GET_ALL_TICK takes a struct sir_batch (like SIR_IOCTL_GET_ALL) but reports
+//points to an array of struct sir_tick_report.  The tick state is collected in the
+//same pass as the interrupt counters.
+
+//Flags in struct sir_tick_state
+#define SIR_TICK_NOHZ_FULL 0x1      //The CPU is in the nohz_full set
+#define SIR_TICK_STOPPED 0x2        //The tick is currently stopped (only valid if SIR_TICK_STATE_VALID)
+#define SIR_TICK_STATE_VALID 0x4    //The tick stopped state could be read
+#define SIR_TICK_NEXT_VALID 0x8     //next_event_ns could be read
+#define SIR_TICK_TRACKED 0x10       //The tick stop counters are being collected (module loaded with tick_tracking=1)
+
+//Reasons the tick could not be stopped.  These are the kernel's tick dependency
+//bits (TICK_DEP_BIT_*).  SIR_TICK_DEP_OTHER counts failed stops with no dependency bit set.
+#define SIR_TICK_DEP_POSIX_TIMER 0
+#define SIR_TICK_DEP_PERF_EVENTS 1
+#define SIR_TICK_DEP_SCHED 2
+#define SIR_TICK_DEP_CLOCK_UNSTABLE 3
+#define SIR_TICK_DEP_RCU 4
+#define SIR_TICK_DEP_RCU_EXP 5
+#define SIR_TICK_DEP_OTHER 6
+#define SIR_TICK_NUM_DEPS 8
+
+struct sir_tick_state{
+        uint32_t flags;                     //SIR_TICK_* flags
+        uint32_t last_dependency;           //Dependency mask (1 << SIR_TICK_DEP_*) of the last failed stop
+        uint64_t next_event_ns;             //Next programmed timer interrupt (CLOCK_MONOTONIC ns, UINT64_MAX if none)
+        uint64_t tick_stops;                //Number of times the tick was stopped (since the module was loaded)
+        uint64_t tick_restarts;             //Number of times the tick was restarted after being stopped
+        uint64_t stop_failures;             //Number of attempts to stop the tick which failed due to a dependency
+        uint64_t dependency_counts[SIR_TICK_NUM_DEPS]; //Failed stops by dependency (indexed by SIR_TICK_DEP_*)
+};
+
+//Entry for SIR_IOCTL_GET_ALL_TICK
+struct sir_tick_report{
+        struct sir_report report;
+        struct sir_tick_state tick;
+};
+
+//io_uring Support
+//The GET, GET_DETAILED, and GET_ALL commands can be submitted as IORING_OP_URING_CMD
+//requests with sqe->cmd_op set to the ioctl number and the command area of the SQE
+//(sqe->cmd, 16 bytes, no IORING_SETUP_SQE128 needed) holding a struct sir_uring_cmd.
+//The result is written to addr:
+//  SIR_IOCTL_GET:          a SIR_INTERRUPT_TYPE total for the CPU which issued the command
+//  SIR_IOCTL_GET_DETAILED: a struct sir_report for the CPU which issued the command
+//  SIR_IOCTL_GET_ALL:      an array of struct sir_report indexed by CPU (len/sizeof(struct sir_report) entries)
+//If sqe->uring_cmd_flags has IORING_URING_CMD_FIXED set, addr is within the registered
+//buffer selected by sqe->buf_index.  The CQE res is the number of bytes written or -errno.
+//NOTE: The issuing CPU is the submitter's CPU when the command completes inline.  If the
+//      command is punted to an io-wq worker or the ring uses SQPOLL, it is the CPU of that thread.
+struct sir_uring_cmd{
+        uint64_t addr;        //Userspace address of the result buffer
+        uint32_t len;         //Length of the result buffer in bytes
+        uint32_t reserved;
+};
+
+//perf PMU
+//The module registers a "sir" PMU (type in /sys/bus/event_source/devices/sir/type).
+//The event config is the index of a field in struct sir_report (in declaration
+//order, ex. 8 = irq_res) or one of the totals below.  The named events are listed
+//in /sys/bus/event_source/devices/sir/events (ex. perf stat -e sir/res/,sir/loc/).
+//Events count the interrupts which land on the CPU (per-CPU events) or on
+//whichever CPU the task is running on while it is running (per-task events).
+//Sampling is not supported.
+#define SIR_PMU_EVENT_IRQ_TOTAL 32     //irq_std + arch_irq_stat_sum (same as SIR_IOCTL_GET)
+#define SIR_PMU_EVENT_SOFTIRQ_TOTAL 33 //Sum of all softirqs
+#define SIR_PMU_EVENT_MAX 34
+
+//Named CPU groups are registered with SIR_IOCTL_GROUP_ADD and are shared by
+//all users of the device.  SIR_IOCTL_GROUP_GET returns the sum of the
+//sir_report of every online CPU in the group.
+#define SIR_GROUP_NAME_LEN 32
+#define SIR_GROUP_MAX 32
+#define SIR_GROUP_MAX_CPUS 1024
+#define SIR_GROUP_MASK_WORDS (SIR_GROUP_MAX_CPUS/64)
+
+//Flags for struct sir_group_def
+#define SIR_GROUP_SMT_SIBLINGS 0x1 //Also include the SMT siblings of each CPU in the group
+
+//Argument for SIR_IOCTL_GROUP_ADD and SIR_IOCTL_GROUP_REMOVE (only name is used for remove)
+//Adding a group with the name of an existing group replaces it
+struct sir_group_def{
+        char name[SIR_GROUP_NAME_LEN];         //Null terminated group name
+        uint32_t flags;
+        uint32_t reserved;
+        uint64_t cpus[SIR_GROUP_MASK_WORDS];   //CPU i is in the group if bit (i%64) of cpus[i/64] is set
+};
+
+//Argument for SIR_IOCTL_GROUP_GET
+struct sir_group_report{
+        char name[SIR_GROUP_NAME_LEN];         //In: name of the group
+        uint32_t num_cpus;                     //Out: number of online CPUs summed
+        uint32_t reserved;
+        struct sir_report report;              //Out: sum of the reports for the CPUs in the group
+};
+
+//IPI Origin Attribution
+//When the module is loaded with ipi_attribution=1 (requires 6.5+), the IPIs sent to
+//each CPU are counted by (source CPU, source task, callback) using the ipi_send_cpu,
+//ipi_send_cpumask, and csd_queue_cpu tracepoints.  SIR_IOCTL_IPI_GET returns the table
+//for one target CPU.  The counts are relative to the last SIR_IOCTL_IPI_RESET on the
+//same file handle (arg = target CPU or -1 for all CPUs) and are otherwise cumulative
+//since the module was loaded.  SIR_IOCTL_IPI_CLEAR (same argument) removes every entry
+//of the tables and resets the dropped counts for all users, freeing the slots for new
+//sources.  All three return -ENODEV if attribution is not enabled.
+//Function call IPIs are counted against the function queued by csd_queue_cpu just
+//before the IPI, so the IPIs and calls for one callback share an entry.
+#define SIR_IPI_COMM_LEN 16
+#define SIR_IPI_SYM_LEN 64
+
+//Kinds of IPI
+#define SIR_IPI_KIND_RESCHED 0 //Reschedule IPI (RES), symbol is the function which sent it
+#define SIR_IPI_KIND_CALL 1    //Function call IPI (CAL), symbol is the callback
+#define SIR_IPI_KIND_TLB 2     //TLB shootdown (counted in CAL and TLB), symbol is the flush callback
+
+struct sir_ipi_entry{
+        uint32_t src_cpu;                   //CPU which sent the IPI
+        uint32_t kind;                      //SIR_IPI_KIND_*
+        char comm[SIR_IPI_COMM_LEN];        //Task which sent the IPI (<hardirq> or <softirq> if sent from interrupt context)
+        char symbol[SIR_IPI_SYM_LEN];       //Callback or sending function
+        uint64_t ipis;                      //Number of IPIs sent
+        uint64_t calls;                     //Number of cross-CPU function calls queued (several calls can share one IPI)
+};
+
+//Argument for SIR_IOCTL_IPI_GET
+struct sir_ipi_query{
+        uint32_t cpu;                       //In: target CPU
+        uint32_t num_entries;               //In: number of entries in entries, Out: number of entries written
+        uint32_t total_entries;             //Out: number of entries with non-zero counts (can exceed num_entries)
+        uint32_t reserved;
+        uint64_t dropped;                   //Out: IPIs which were not counted because the table for the CPU was full (since load or clear)
+        uint64_t entries;                   //Userspace pointer to an array of struct sir_ipi_entry
+};
+
+//Shared Sampling Sessions
+//A session samples the selected fields of a set of CPUs once per period from a
+//single kernel thread and appends one record per online CPU to a ring shared by
+//every file handle attached to it.  Each file handle has its own read position in
+//the ring, so any number of readers (ex. an exporter, a watchdog, and an
+//interactive tool) share one capture.  The session is created by the first
+//SIR_IOCTL_SESSION_ATTACH with its name and is stopped when the last file handle
+//detaches (or is closed).  A file handle is attached to at most one session.
+//poll() on an attached file handle reports POLLIN when records are available.
+#define SIR_SESSION_NAME_LEN 32
+#define SIR_SESSION_MAX 16
+#define SIR_SESSION_MIN_PERIOD_NS 10000
+#define SIR_SESSION_DEFAULT_PERIODS 1024
+
+//Argument for SIR_IOCTL_SESSION_ATTACH
+//If a session with the name already exists, the definition is ignored and is
+//overwritten with the definition of the existing session.  Returns -EBUSY if
+//the file handle is already attached to a session.
+struct sir_session_def{
+        char name[SIR_SESSION_NAME_LEN];       //Null terminated session name
+        uint64_t fields;                       //Bit i selects field i (same numbering as the perf events), 0 = every sir_report field
+        uint64_t period_ns;                    //Sampling period (at least SIR_SESSION_MIN_PERIOD_NS)
+        uint32_t periods;                      //Ring capacity in sampling periods (0 = SIR_SESSION_DEFAULT_PERIODS)
+        uint32_t record_size;                  //Out: size of each record in bytes
+        uint64_t cpus[SIR_GROUP_MASK_WORDS];   //CPU i is sampled if bit (i%64) of cpus[i/64] is set
+};
+
+//Each record is followed by one SIR_INTERRUPT_TYPE per selected field in
+//field index order (record_size bytes in total)
+struct sir_session_record{
+        uint64_t seq;                          //Sampling period since the session was created
+        uint64_t time_ns;                      //CLOCK_MONOTONIC time the period was captured
+        uint32_t cpu;
+        uint32_t num_fields;
+};
+
+//Flags for struct sir_session_read
+//SIR_SESSION_READ_WAIT blocks until at least one record is available.  Other calls on
+//the same file handle are not held off while it waits.  If the file handle is detached
+//while waiting, the read returns -ENOENT (and -EINTR if interrupted by a signal).
+#define SIR_SESSION_READ_WAIT 0x1
+
+//Argument for SIR_IOCTL_SESSION_READ
+//Returns -ENOENT if the file handle is not attached to a session
+struct sir_session_read{
+        uint32_t max_records;                  //In: number of records which fit in buf
+        uint32_t num_records;                  //Out: number of records written
+        uint32_t record_size;                  //Out: size of each record in bytes
+        uint32_t flags;                        //In: SIR_SESSION_READ_*
+        uint64_t lost;                         //Out: records overwritten before this file handle read them (since the last read)
+        uint64_t buf;                          //Userspace pointer to max_records*record_size bytes
+};
+
+#endif
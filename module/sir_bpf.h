@@ -0,0 +1,24 @@
+#ifndef _H_SIR_BPF
+#define _H_SIR_BPF
+
+//Declarations of the sir kfuncs for BPF programs.
+//Include after vmlinux.h (or a header generated from the sir module BTF with
+//bpftool btf dump file /sys/kernel/btf/sir format c) and bpf_helpers.h.
+//The kfuncs are available to BPF_PROG_TYPE_TRACING programs (fentry, fexit, tp_btf).
+
+#define SIR_BPF_CURRENT_CPU -1
+
+//Fills buf with the struct sir_report for the CPU (or the first buf__sz bytes of it).
+//Returns the number of bytes written or -EINVAL.
+extern int bpf_sir_get_report(int cpu, void *buf, __u32 buf__sz) __ksym;
+
+//Reads a single counter.  idx is the index of the field in struct sir_report or one
+//of the SIR_PMU_EVENT totals in sir.h (32 = irq_total, 33 = softirq_total).
+//Returns 0 or -EINVAL.
+extern int bpf_sir_get_counter(int cpu, __u32 idx, __u64 *value) __ksym;
+
+//Ex. interrupts which landed during a NAPI poll:
+//  SEC("fentry/__napi_poll") read idx 32 into a per-CPU map entry
+//  SEC("fexit/__napi_poll")  read idx 32 again and add the difference to a histogram
+
+#endif
@@ -10,6 +10,95 @@
     #include <linux/types.h>
     #include <linux/mutex.h>
     
+    #include <linux/version.h>
+
+    //io_uring command support requires registered buffer import (added in 6.1)
+    #if IS_ENABLED(CONFIG_IO_URING) && LINUX_VERSION_CODE >= KERNEL_VERSION(6,1,0)
+        #define SIR_URING_CMD
+        #if LINUX_VERSION_CODE >= KERNEL_VERSION(6,7,0)
+            #include <linux/io_uring/cmd.h>
+        #else
+            #include <linux/io_uring.h>
+        #endif
+        #include <linux/uio.h>
+    #endif
+
+    #ifdef CONFIG_PERF_EVENTS
+        #define SIR_PMU
+        #include <linux/perf_event.h>
+    #endif
+
+    //Module kfuncs require module BTF and the kfunc flags set (added in 6.2)
+    #if defined(CONFIG_BPF_SYSCALL) && IS_ENABLED(CONFIG_DEBUG_INFO_BTF_MODULES) && LINUX_VERSION_CODE >= KERNEL_VERSION(6,2,0)
+        #define SIR_BPF
+        #include <linux/bpf.h>
+        #include <linux/btf.h>
+        #include <linux/btf_ids.h>
+        #ifndef __bpf_kfunc
+            //Added in 6.3
+            #define __bpf_kfunc __used noinline
+        #endif
+        #ifndef __bpf_kfunc_start_defs
+            //Added in 6.7
+            #define __bpf_kfunc_start_defs() __diag_push(); __diag_ignore_all("-Wmissing-prototypes", "Global kfuncs as their definitions will be in BTF")
+            #define __bpf_kfunc_end_defs() __diag_pop()
+        #endif
+        #ifndef BTF_KFUNCS_START
+            //Added in 6.9
+            #define BTF_KFUNCS_START(name) BTF_SET8_START(name)
+            #define BTF_KFUNCS_END(name) BTF_SET8_END(name)
+        #endif
+    #endif
+
+    //irq_hv_callback_count is in irq_cpustat_t with CONFIG_X86_HV_CALLBACK_VECTOR as of
+    //5.8 and with CONFIG_HYPERV or CONFIG_XEN before
+    #if defined(CONFIG_X86_HV_CALLBACK_VECTOR) || \
+        (LINUX_VERSION_CODE < KERNEL_VERSION(5,8,0) && (IS_ENABLED(CONFIG_HYPERV) || defined(CONFIG_XEN)))
+        #define SIR_HV_CALLBACK
+    #endif
+
+    //The ipi_send_cpu, ipi_send_cpumask, and csd_queue_cpu tracepoints were added in 6.5
+    #if defined(CONFIG_TRACEPOINTS) && defined(CONFIG_SMP) && LINUX_VERSION_CODE >= KERNEL_VERSION(6,5,0)
+        #define SIR_IPI
+        #include <linux/spinlock.h>
+        #include <linux/jhash.h>
+        #include <linux/sched.h>
+    #endif
+
+    //The tick_stop tracepoint reports the dependency which kept the tick running as of 4.6
+    #if defined(CONFIG_TRACEPOINTS) && defined(CONFIG_NO_HZ_COMMON) && LINUX_VERSION_CODE >= KERNEL_VERSION(4,6,0)
+        #define SIR_TICK
+        #include <linux/tick.h>
+        #include <linux/clockchips.h>
+    #endif
+
+    #if defined(SIR_IPI) || defined(SIR_TICK)
+        #define SIR_TRACEPOINTS
+        #include <linux/tracepoint.h>
+    #endif
+
+    //Self instrumentation is enabled by module/Makefile (SIR_STATS=0 compiles it out)
+    //and is exposed in debugfs
+    #if defined(SIR_STATS) && !defined(CONFIG_DEBUG_FS)
+        #undef SIR_STATS
+    #endif
+    #ifdef SIR_STATS
+        #include <linux/debugfs.h>
+        #include <linux/seq_file.h>
+        #include <linux/log2.h>
+        #include <linux/timex.h>
+    #endif
+
+    //Shared sampling sessions
+    #include <linux/kthread.h>
+    #include <linux/hrtimer.h>
+    #include <linux/wait.h>
+    #include <linux/poll.h>
+    #include <linux/spinlock.h>
+    #include <linux/vmalloc.h>
+    #include <linux/log2.h>
+    #include <linux/bitops.h>
+
     #include "sir.h" //Get the numbers defined for IOCTL calls
 
     //==== Init Functions ====
@@ -23,6 +112,32 @@
     loff_t sir_llseek(struct file *filp, loff_t off, int whence);
     ssize_t sir_read(struct file *filp, char __user *buf, size_t count, loff_t *f_pos);
     long sir_ioctl(struct file *filp, unsigned int cmd, unsigned long arg);
+    __poll_t sir_poll(struct file *filp, struct poll_table_struct *wait);
+    #ifdef SIR_URING_CMD
+    int sir_uring_cmd(struct io_uring_cmd *ioucmd, unsigned int issue_flags);
+    #endif
+
+    //==== Counter Gathering ====
+    struct partial_read_state;
+    void sir_snapshot_total(int cpu, struct partial_read_state* partial_state);
+    void sir_snapshot_detailed(int cpu, struct partial_read_state* partial_state);
+
+    void get_tick_state(int cpu, struct sir_tick_state* tick);
+
+    u64 sir_counter_value(int cpu, unsigned int idx);
+    int sir_counter_is_32bit(unsigned int idx);
+
+    //==== IOCTL Helpers ====
+    long sir_get_all(struct partial_read_state* partial_state, unsigned long arg, int with_tick);
+    long sir_group_add(unsigned long arg);
+    long sir_group_remove(unsigned long arg);
+    long sir_group_get(struct partial_read_state* partial_state, unsigned long arg);
+    long sir_ipi_get(struct partial_read_state* partial_state, unsigned long arg);
+    long sir_ipi_reset(struct partial_read_state* partial_state, unsigned long arg);
+    long sir_ipi_clear(unsigned long arg);
+    long sir_session_attach(struct partial_read_state* partial_state, unsigned long arg);
+    long sir_session_detach(struct partial_read_state* partial_state);
+    long sir_session_read(struct partial_read_state* partial_state, unsigned long arg);
 
     // ==== Structure for partial reads ====
     struct partial_read_state{
@@ -54,8 +169,8 @@
 
         //Excluding: ERR and MIS entries since they appear to be global (in any case are atomic)
 
-        SIR_INTERRUPT_TYPE arch_irq_stat_sum; //This is the sum of the above interrupts but is gathered using arch_irq_stat_cpu(unsigned int cpu)
-                                              //This is collected because some variables are not exported but are read by this function
+        SIR_INTERRUPT_TYPE arch_irq_stat_sum; //This is the sum of the x86 specific interrupts computed the same way as arch_irq_stat_cpu(unsigned int cpu)
+                                              //in arch/x86/kernel/irq.c (which excludes TLB since TLB shootdowns are counted in CAL)
 
         SIR_INTERRUPT_TYPE softirq_hi;
         SIR_INTERRUPT_TYPE softirq_timer;
@@ -71,9 +186,130 @@
 
         char ind;
         unsigned long irq_flags[CONFIG_NR_CPUS];
+        struct sir_ipi_baseline* ipi_baseline; //Counts at the last SIR_IOCTL_IPI_RESET per CPU (allocated on the first reset)
+        struct sir_session* session;        //Session this file handle is attached to (or NULL)
+        u64 session_cursor;                 //Index of the next record to read from the session ring
+        struct list_head session_node;      //Entry in the readers of the session (protected by its ring_lock)
+        wait_queue_head_t session_wait;     //Woken when the session has new records.  Kept with the file handle
+                                            //rather than the session so poll never waits on a freed session.
         struct mutex lock;
     } ;
 
+    // ==== Structure for CPU groups ====
+    struct sir_group{
+        char name[SIR_GROUP_NAME_LEN];
+        int in_use;
+        struct cpumask mask; //Includes the SMT siblings if requested when the group was added
+    };
+
+    // ==== Structure for shared sampling sessions ====
+    //The ring holds capacity records (a power of 2).  head is the number of
+    //records written since the session was created, so record i is stored at
+    //index i & (capacity-1) and has been overwritten once head - i > capacity.
+    struct sir_session{
+        char name[SIR_SESSION_NAME_LEN];
+        int refs;                           //Attached file handles and waiting reads (protected by sir_sessions_lock)
+        struct cpumask mask;
+        u64 fields;
+        u32 num_fields;
+        u32 periods;
+        u64 period_ns;
+        u32 record_size;
+        u64 capacity;
+        u64 head;
+        u64 seq;                            //Sampling periods captured (only used by the sampling thread)
+        char* ring;
+        spinlock_t ring_lock;               //Protects the ring, head, and readers
+        struct list_head readers;           //partial_read_state of each attached file handle
+        struct task_struct* thread;
+    };
+
+    // ==== Structures for IPI attribution ====
+    #define SIR_IPI_TABLE_SIZE 256 //Entries per target CPU (power of 2)
+
+    struct sir_ipi_count{
+        u64 ipis;
+        u64 calls;
+    };
+
+    //Entries are only removed by SIR_IOCTL_IPI_CLEAR so an entry keeps its index until then
+    struct sir_ipi_slot{
+        int in_use;
+        u32 src_cpu;
+        u32 kind;
+        unsigned long func;                 //Callback or (for reschedule IPIs) the call site
+        char comm[SIR_IPI_COMM_LEN];
+        struct sir_ipi_count count;
+    };
+
+    struct sir_ipi_table{
+        raw_spinlock_t lock;                //Taken by the sending CPUs (any context)
+        atomic64_t dropped;                 //Incremented without the lock if it cannot be taken from NMI context
+        u64 generation;                     //Incremented by SIR_IOCTL_IPI_CLEAR
+        struct sir_ipi_slot slots[SIR_IPI_TABLE_SIZE];
+    };
+
+    //A baseline is ignored once the table it was taken from has been cleared
+    struct sir_ipi_baseline{
+        u64 generation;
+        struct sir_ipi_count counts[SIR_IPI_TABLE_SIZE];
+    };
+
+    //Last cross-CPU call queued by a CPU (see sir_ipi_call_func)
+    struct sir_ipi_pending{
+        unsigned long func;
+        int target;                         //CPU the call was queued for (-1 if none)
+    };
+
+    // ==== Structure for tick diagnostics ====
+    //Updated by the tick_stop tracepoint on the CPU the counters belong to
+    struct sir_tick_counters{
+        u64 tick_stops;
+        u64 stop_failures;
+        u32 last_dependency;
+        u64 dependency_counts[SIR_TICK_NUM_DEPS];
+    };
+
+    // ==== Structures for self instrumentation ====
+    //Operations which are timed
+    enum sir_stat_op{
+        SIR_STAT_READ,
+        SIR_STAT_GET,
+        SIR_STAT_GET_DETAILED,
+        SIR_STAT_GET_ALL,
+        SIR_STAT_GET_ALL_TICK,
+        SIR_STAT_GROUP,
+        SIR_STAT_IPI,
+        SIR_STAT_SESSION,
+        SIR_STAT_IRQ_CONTROL,
+        SIR_STAT_URING_GET,
+        SIR_STAT_URING_GET_DETAILED,
+        SIR_STAT_URING_GET_ALL,
+        SIR_STAT_OTHER,
+        SIR_STAT_NUM_OPS
+    };
+
+    #define SIR_STATS_HIST_BUCKETS 32 //log2(cycles) buckets
+
+    struct sir_op_stats{
+        u64 calls;
+        u64 total_cycles;
+        u64 max_cycles;
+        u64 hist[SIR_STATS_HIST_BUCKETS];
+    };
+
+    //Updated by the CPU the stats belong to
+    struct sir_cpu_stats{
+        struct sir_op_stats ops[SIR_STAT_NUM_OPS];
+        struct sir_op_stats irq_off;        //Time interrupts were disabled while gathering counters
+        struct sir_op_stats irq_off_user;   //Time between SIR_IOCTL_DISABLE_INTERRUPT and SIR_IOCTL_RESTORE_INTERRUPT
+        u64 irq_off_user_start;
+        u64 snapshot_retries;               //Snapshots re-gathered because an interrupt landed (snapshot_retries > 0)
+        u64 snapshot_fallbacks;             //Snapshots which fell back to disabling interrupts after retrying
+        u64 partial_reads;                  //Reads which returned or completed a partial value
+        u64 lock_contended;                 //Calls which had to wait for another user of the same file
+    };
+
     // ==== Define a debug print macro ====
     #ifdef SIR_DEBUG
         #define printkd(...) printk(__VA_ARGS__)
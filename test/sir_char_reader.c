@@ -126,6 +126,24 @@ void* read_sir_thread(void* arg){
         printf("\tsoftirq_other: %ld\n", report.softirq_other);
     }
 
+    printf("ioctl Batch Driver:\n");
+    {
+        struct sir_report reports[CPU_SETSIZE];
+        struct sir_batch batch;
+        batch.num_reports = CPU_SETSIZE;
+        batch.reports = (uint64_t) (uintptr_t) reports;
+        int status = ioctl(fileno(args->file), SIR_IOCTL_GET_ALL, &batch);
+        if(status < 0){
+            printf("ioctl error!\n");
+            perror(NULL);
+        }else{
+            printf("Possible CPUs: %u\n", batch.num_cpus);
+            for(uint32_t i = 0; i<batch.num_reports; i++){
+                printf("\tCPU %u Interrupts: %ld, Softirq (timer): %ld\n", i, reports[i].irq_std + reports[i].arch_irq_stat_sum, reports[i].softirq_timer);
+            }
+        }
+    }
+
     return NULL;
 }
 
@@ -0,0 +1,175 @@
+/**
+ * A tool for testing the sir perf PMU with a specific core affinity
+ *
+ * Opens a per-task event group with the cycles counter as the
+ * leader and sir events as members so a single read returns the
+ * cycles and the interrupts which landed while the thread ran.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sched.h>
+#include <stdint.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "../module/sir.h"
+
+#define SIR_TEST_ITERS 4
+#define SIR_TEST_SPIN 100000000
+
+typedef struct
+{
+    int cpu;
+    int sir_type;
+} thread_args_t;
+
+typedef struct
+{
+    const char* name;
+    uint64_t config;
+} sir_event_t;
+
+static const sir_event_t sir_events[] = {
+    {"loc", 2},
+    {"res", 8},
+    {"cal", 9},
+    {"irq_total", SIR_PMU_EVENT_IRQ_TOTAL},
+    {"softirq_total", SIR_PMU_EVENT_SOFTIRQ_TOTAL}
+};
+#define SIR_TEST_NUM_EVENTS (sizeof(sir_events)/sizeof(sir_events[0]))
+
+static int perf_open(uint32_t type, uint64_t config, int group_fd){
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = group_fd < 0;
+    attr.read_format = PERF_FORMAT_GROUP;
+    return syscall(__NR_perf_event_open, &attr, 0, -1, group_fd, 0);
+}
+
+static int read_pmu_type(){
+    FILE* type_file = fopen("/sys/bus/event_source/devices/sir/type", "r");
+    int type = -1;
+    if(type_file == NULL){
+        return -1;
+    }
+    if(fscanf(type_file, "%d", &type) != 1){
+        type = -1;
+    }
+    fclose(type_file);
+    return type;
+}
+
+void* read_sir_thread(void* arg){
+    thread_args_t *args = (thread_args_t*) arg;
+    int fds[1+SIR_TEST_NUM_EVENTS];
+    uint64_t vals[2+SIR_TEST_NUM_EVENTS]; //nr followed by the values
+
+    fds[0] = perf_open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, -1);
+    if(fds[0] < 0){
+        perror("Unable to open cycles event");
+        return NULL;
+    }
+    for(size_t i = 0; i<SIR_TEST_NUM_EVENTS; i++){
+        fds[1+i] = perf_open(args->sir_type, sir_events[i].config, fds[0]);
+        if(fds[1+i] < 0){
+            perror("Unable to open sir event");
+            return NULL;
+        }
+    }
+
+    printf("perf Driver:\n");
+    for(int i = 0; i<SIR_TEST_ITERS; i++)
+    {
+        ioctl(fds[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+        for(volatile int j = 0; j<SIR_TEST_SPIN; j++){
+        }
+        ioctl(fds[0], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+
+        if(read(fds[0], vals, sizeof(vals)) != sizeof(vals)){
+            perror("Unable to read event group");
+            break;
+        }
+
+        printf("Cycles: %ld\n", vals[1]);
+        for(size_t j = 0; j<SIR_TEST_NUM_EVENTS; j++){
+            printf("\t%s: %ld\n", sir_events[j].name, vals[2+j]);
+        }
+    }
+
+    for(size_t i = 0; i<1+SIR_TEST_NUM_EVENTS; i++){
+        close(fds[i]);
+    }
+
+    return NULL;
+}
+
+void print_help()
+{
+    printf("Usage: sir_perf_reader CPU\n");
+    printf("\tCPU = CPU to run the test on\n");
+}
+
+int main(int argc, char* argv[]){
+    //**** Parse Arguments ****
+    if(argc < 2){
+        printf("Error: No CPU Supplied\n\n");
+        print_help();
+        return 1;
+    }
+
+    int cpu = atoi(argv[1]);
+
+    printf("Running on CPU: %d\n", cpu);
+
+    //**** Setup the Thread ****
+    thread_args_t args;
+    args.cpu = cpu;
+    args.sir_type = read_pmu_type();
+
+    if(args.sir_type < 0){
+        printf("Unable to find the sir PMU, is the module loaded?\n");
+        return 1;
+    }
+
+    cpu_set_t cpu_set;
+    pthread_t pthread;
+    pthread_attr_t pthread_attr;
+
+    int status = pthread_attr_init(&pthread_attr);
+    if(status != 0){
+        printf("Problem initializing pthread_attr\n");
+        exit(1);
+    }
+
+    CPU_ZERO(&cpu_set);
+    CPU_SET(cpu, &cpu_set);
+    status = pthread_attr_setaffinity_np(&pthread_attr, sizeof(cpu_set_t), &cpu_set);
+    if(status != 0){
+        printf("Problem setting thread CPU affinity\n");
+        exit(1);
+    }
+
+    //**** Start Thread ****
+    status = pthread_create(&pthread, &pthread_attr, read_sir_thread, &args);
+    if(status != 0){
+        printf("Problem creating thread\n");
+        exit(1);
+    }
+
+    status = pthread_join(pthread, NULL);
+    if(status != 0){
+        printf("Problem joining thread\n");
+        exit(1);
+    }
+
+    return 0;
+}
@@ -0,0 +1,234 @@
+/**
+ * A tool for testing the sir io_uring commands
+ * with a specific core affinity
+ *
+ * Each iteration submits GET, GET_DETAILED, and GET_ALL
+ * commands in a single io_uring_enter call.  GET writes to
+ * a normal buffer while GET_DETAILED and GET_ALL write into
+ * a registered buffer.
+ *
+ * liburing is not required, the ring is set up with the
+ * raw system calls.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sched.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+
+#include "../module/sir.h"
+
+#define SIR_TEST_ITERS 4
+#define SIR_TEST_MAX_CPUS 1024
+#define SIR_RING_ENTRIES 8
+
+typedef struct
+{
+    int fd;
+    unsigned* sq_tail;
+    unsigned* sq_mask;
+    unsigned* sq_array;
+    unsigned* cq_head;
+    unsigned* cq_tail;
+    unsigned* cq_mask;
+    struct io_uring_sqe* sqes;
+    struct io_uring_cqe* cqes;
+} ring_t;
+
+typedef struct
+{
+    int cpu;
+    int sir_fd;
+} thread_args_t;
+
+static int ring_setup(ring_t* ring){
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+
+    ring->fd = syscall(__NR_io_uring_setup, SIR_RING_ENTRIES, &params);
+    if(ring->fd < 0){
+        perror("io_uring_setup");
+        return -1;
+    }
+
+    size_t sq_len = params.sq_off.array + params.sq_entries*sizeof(unsigned);
+    size_t cq_len = params.cq_off.cqes + params.cq_entries*sizeof(struct io_uring_cqe);
+    uint8_t* sq = (uint8_t*) mmap(NULL, sq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+    uint8_t* cq = (uint8_t*) mmap(NULL, cq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+    ring->sqes = (struct io_uring_sqe*) mmap(NULL, params.sq_entries*sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if(sq == MAP_FAILED || cq == MAP_FAILED || ring->sqes == MAP_FAILED){
+        perror("Unable to map io_uring");
+        return -1;
+    }
+
+    ring->sq_tail = (unsigned*) (sq + params.sq_off.tail);
+    ring->sq_mask = (unsigned*) (sq + params.sq_off.ring_mask);
+    ring->sq_array = (unsigned*) (sq + params.sq_off.array);
+    ring->cq_head = (unsigned*) (cq + params.cq_off.head);
+    ring->cq_tail = (unsigned*) (cq + params.cq_off.tail);
+    ring->cq_mask = (unsigned*) (cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe*) (cq + params.cq_off.cqes);
+
+    return 0;
+}
+
+static void queue_sir_cmd(ring_t* ring, int sir_fd, uint32_t cmd_op, void* addr, uint32_t len, int fixed){
+    unsigned tail = *(ring->sq_tail);
+    unsigned idx = tail & *(ring->sq_mask);
+    struct io_uring_sqe* sqe = &(ring->sqes[idx]);
+    struct sir_uring_cmd cmd;
+
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_URING_CMD;
+    sqe->fd = sir_fd;
+    sqe->cmd_op = cmd_op;
+    sqe->user_data = cmd_op;
+    if(fixed){
+        sqe->uring_cmd_flags = IORING_URING_CMD_FIXED;
+        sqe->buf_index = 0;
+    }
+
+    cmd.addr = (uint64_t) (uintptr_t) addr;
+    cmd.len = len;
+    cmd.reserved = 0;
+    memcpy(sqe->cmd, &cmd, sizeof(cmd));
+
+    ring->sq_array[idx] = idx;
+    __atomic_store_n(ring->sq_tail, tail+1, __ATOMIC_RELEASE);
+}
+
+void* read_sir_thread(void* arg){
+    thread_args_t *args = (thread_args_t*) arg;
+    ring_t ring;
+
+    if(ring_setup(&ring) != 0){
+        return NULL;
+    }
+
+    //GET_DETAILED result followed by the GET_ALL results
+    size_t fixed_len = sizeof(struct sir_report)*(1+SIR_TEST_MAX_CPUS);
+    struct sir_report* fixed_buf = (struct sir_report*) malloc(fixed_len);
+    if(fixed_buf == NULL){
+        printf("Unable to allocate buffer\n");
+        return NULL;
+    }
+    struct iovec iov = {fixed_buf, fixed_len};
+    if(syscall(__NR_io_uring_register, ring.fd, IORING_REGISTER_BUFFERS, &iov, 1) < 0){
+        perror("Unable to register buffer");
+        return NULL;
+    }
+
+    printf("io_uring Driver:\n");
+    for(int i = 0; i<SIR_TEST_ITERS; i++)
+    {
+        uint64_t interrupts = 0;
+
+        queue_sir_cmd(&ring, args->sir_fd, SIR_IOCTL_GET, &interrupts, sizeof(interrupts), 0);
+        queue_sir_cmd(&ring, args->sir_fd, SIR_IOCTL_GET_DETAILED, &fixed_buf[0], sizeof(struct sir_report), 1);
+        queue_sir_cmd(&ring, args->sir_fd, SIR_IOCTL_GET_ALL, &fixed_buf[1], sizeof(struct sir_report)*SIR_TEST_MAX_CPUS, 1);
+
+        int status = syscall(__NR_io_uring_enter, ring.fd, 3, 3, IORING_ENTER_GETEVENTS, NULL, 0);
+        if(status < 0){
+            perror("io_uring_enter");
+            break;
+        }
+
+        printf("Snapshot\n");
+        unsigned head = *(ring.cq_head);
+        while(head != __atomic_load_n(ring.cq_tail, __ATOMIC_ACQUIRE)){
+            struct io_uring_cqe* cqe = &(ring.cqes[head & *(ring.cq_mask)]);
+            if(cqe->res < 0){
+                printf("\tCommand %llx error: %s\n", cqe->user_data, strerror(-cqe->res));
+            }else if(cqe->user_data == SIR_IOCTL_GET){
+                printf("\tInterrupts: %ld\n", interrupts);
+            }else if(cqe->user_data == SIR_IOCTL_GET_DETAILED){
+                printf("\tDetailed: irq_std: %ld, irq_loc: %ld, softirq_timer: %ld\n", fixed_buf[0].irq_std, fixed_buf[0].irq_loc, fixed_buf[0].softirq_timer);
+            }else if(cqe->user_data == SIR_IOCTL_GET_ALL){
+                int num_reports = cqe->res/sizeof(struct sir_report);
+                printf("\tAll (%d CPUs):\n", num_reports);
+                for(int cpu = 0; cpu<num_reports; cpu++){
+                    printf("\t\tCPU %d Interrupts: %ld\n", cpu, fixed_buf[1+cpu].irq_std + fixed_buf[1+cpu].arch_irq_stat_sum);
+                }
+            }
+            head++;
+        }
+        __atomic_store_n(ring.cq_head, head, __ATOMIC_RELEASE);
+    }
+
+    close(ring.fd);
+    free(fixed_buf);
+
+    return NULL;
+}
+
+void print_help()
+{
+    printf("Usage: sir_uring_reader CPU\n");
+    printf("\tCPU = CPU to run the test on\n");
+}
+
+int main(int argc, char* argv[]){
+    //**** Parse Arguments ****
+    if(argc < 2){
+        printf("Error: No CPU Supplied\n\n");
+        print_help();
+        return 1;
+    }
+
+    int cpu = atoi(argv[1]);
+
+    printf("Running on CPU: %d\n", cpu);
+
+    //**** Setup the Thread ****
+    thread_args_t args;
+    args.cpu = cpu;
+    args.sir_fd = open("/dev/sir0", O_RDONLY);
+
+    if(args.sir_fd < 0){
+        perror("Unable to open /dev/sir0");
+        return 1;
+    }
+
+    cpu_set_t cpu_set;
+    pthread_t pthread;
+    pthread_attr_t pthread_attr;
+
+    int status = pthread_attr_init(&pthread_attr);
+    if(status != 0){
+        printf("Problem initializing pthread_attr\n");
+        exit(1);
+    }
+
+    CPU_ZERO(&cpu_set);
+    CPU_SET(cpu, &cpu_set);
+    status = pthread_attr_setaffinity_np(&pthread_attr, sizeof(cpu_set_t), &cpu_set);
+    if(status != 0){
+        printf("Problem setting thread CPU affinity\n");
+        exit(1);
+    }
+
+    //**** Start Thread ****
+    status = pthread_create(&pthread, &pthread_attr, read_sir_thread, &args);
+    if(status != 0){
+        printf("Problem creating thread\n");
+        exit(1);
+    }
+
+    status = pthread_join(pthread, NULL);
+    if(status != 0){
+        printf("Problem joining thread\n");
+        exit(1);
+    }
+
+    close(args.sir_fd);
+
+    return 0;
+}
@@ -0,0 +1,723 @@
+/**
+ * A/B comparison of the interrupt profile of a workload
+ *
+ * run:     Runs a command (optionally pinned to a set of CPUs) while
+ *          sampling the sir_report of a set of CPUs.  All CPUs are read
+ *          with a single SIR_IOCTL_GET_ALL call per period from this
+ *          (housekeeping) thread so the measured CPUs are not disturbed
+ *          by the sampler.  The profile is written in the sir_record
+ *          trace format (see sir_trace.h) so it can also be inspected
+ *          with sir_analyze.
+ * compare: Splits two profiles into fixed windows and compares, per CPU
+ *          and per class, the mean rate, the burst percentiles of the
+ *          per-window counts, and whether the distributions of the
+ *          per-window counts differ (two-sided Mann-Whitney U test) or
+ *          bursts above the baseline's percentile became more frequent.
+ *
+ * compare returns 2 if any class regressed so it can be used to gate
+ * tuning changes (boot parameters, IRQ affinity, BIOS settings).
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <sched.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "sir_trace.h"
+
+//Classes are the sir_report fields followed by the totals
+#define CLASS_IRQ SIR_REPORT_NUM_FIELDS
+#define CLASS_SOFTIRQ (SIR_REPORT_NUM_FIELDS+1)
+#define NUM_CLASSES (SIR_REPORT_NUM_FIELDS+2)
+
+typedef struct
+{
+    int seen;
+    uint64_t first_window;
+    uint64_t last_window;
+    SIR_INTERRUPT_TYPE last[SIR_REPORT_NUM_FIELDS];
+    uint64_t* counts; //NUM_CLASSES rows of num_windows per-window counts
+} profile_cpu_t;
+
+typedef struct
+{
+    const char* path;
+    uint64_t window_ns;
+    uint64_t num_windows;
+    int num_cpus;
+    profile_cpu_t* cpus;
+    double duration_s;
+} profile_t;
+
+typedef struct
+{
+    uint64_t n;
+    double mean;   //Per second
+    double pct;    //Per second
+    double max;    //Per second
+} class_stats_t;
+
+typedef struct
+{
+    double val;
+    int group;
+} ranked_t;
+
+static const char* class_name(int class){
+    if(class == CLASS_IRQ){
+        return "irq";
+    }else if(class == CLASS_SOFTIRQ){
+        return "softirq";
+    }
+    return sir_report_field_names[class];
+}
+
+//==== Run ====
+
+static void add_ns(struct timespec* ts, uint64_t ns){
+    ts->tv_nsec += ns % 1000000000ULL;
+    ts->tv_sec += ns / 1000000000ULL;
+    if(ts->tv_nsec >= 1000000000L){
+        ts->tv_nsec -= 1000000000L;
+        ts->tv_sec++;
+    }
+}
+
+static int run_profile(int argc, char* argv[]){
+    const char* path = NULL;
+    const char* cpu_list = NULL;
+    const char* cmd_cpu_list = NULL;
+    int sampler_cpu = -1;
+    uint64_t period_us = 1000;
+    double settle_s = 0;
+    int opt;
+
+    //**** Parse Arguments ****
+    optind = 1;
+    while((opt = getopt(argc, argv, "+o:c:a:s:p:w:h")) != -1){
+        switch(opt){
+            case 'o':
+                path = optarg;
+                break;
+            case 'c':
+                cpu_list = optarg;
+                break;
+            case 'a':
+                cmd_cpu_list = optarg;
+                break;
+            case 's':
+                sampler_cpu = atoi(optarg);
+                break;
+            case 'p':
+                period_us = strtoull(optarg, NULL, 10);
+                break;
+            case 'w':
+                settle_s = atof(optarg);
+                break;
+            default:
+                return -1;
+        }
+    }
+
+    if(path == NULL || cpu_list == NULL || period_us == 0 || optind >= argc){
+        printf("Error: Missing or invalid arguments\n\n");
+        return -1;
+    }
+
+    cpu_set_t cpus;
+    cpu_set_t cmd_cpus;
+    if(sir_parse_cpu_list(cpu_list, &cpus) != 0){
+        printf("Error: Invalid CPU list: %s\n", cpu_list);
+        return 1;
+    }
+    if(cmd_cpu_list != NULL && sir_parse_cpu_list(cmd_cpu_list, &cmd_cpus) != 0){
+        printf("Error: Invalid CPU list: %s\n", cmd_cpu_list);
+        return 1;
+    }
+
+    //**** Setup ****
+    if(sampler_cpu >= 0){
+        cpu_set_t cpu_set;
+        CPU_ZERO(&cpu_set);
+        CPU_SET(sampler_cpu, &cpu_set);
+        if(sched_setaffinity(0, sizeof(cpu_set), &cpu_set) != 0){
+            perror("Unable to pin the sampler");
+            return 1;
+        }
+    }
+
+    int fd = open("/dev/sir0", O_RDONLY);
+    if(fd < 0){
+        perror("Unable to open /dev/sir0");
+        return 1;
+    }
+
+    int num_cpus = sir_num_cpus(fd);
+    if(num_cpus <= 0){
+        perror("Unable to get the number of CPUs");
+        close(fd);
+        return 1;
+    }
+
+    struct sir_report* reports = (struct sir_report*) calloc(num_cpus, sizeof(struct sir_report));
+    sir_trace_encoder_t* encoders = (sir_trace_encoder_t*) calloc(num_cpus, sizeof(sir_trace_encoder_t));
+    if(reports == NULL || encoders == NULL){
+        printf("Unable to allocate reports\n");
+        close(fd);
+        return 1;
+    }
+    for(int cpu = 0; cpu<num_cpus && cpu<CPU_SETSIZE; cpu++){
+        if(CPU_ISSET(cpu, &cpus) && sir_trace_encoder_init(&encoders[cpu], cpu, SIR_TRACE_DEFAULT_CHUNK_SAMPLES) != 0){
+            close(fd);
+            return 1;
+        }
+    }
+
+    uint64_t start_time_ns = sir_time_ns();
+    uint64_t record_time_ns = start_time_ns + (uint64_t) (settle_s*1e9);
+    sir_trace_writer_t writer;
+    if(sir_trace_writer_open(&writer, path, record_time_ns) != 0){
+        close(fd);
+        return 1;
+    }
+
+    //The command inherits the signal dispositions so only the command is
+    //interrupted by SIGINT and the profile is still written
+    signal(SIGINT, SIG_IGN);
+
+    //**** Start the Command ****
+    pid_t pid = fork();
+    if(pid < 0){
+        perror("Unable to fork");
+        sir_trace_writer_close(&writer);
+        close(fd);
+        return 1;
+    }
+    if(pid == 0){
+        signal(SIGINT, SIG_DFL);
+        close(fd);
+        if(cmd_cpu_list != NULL && sched_setaffinity(0, sizeof(cmd_cpus), &cmd_cpus) != 0){
+            perror("Unable to pin the command");
+            _exit(127);
+        }
+        execvp(argv[optind], &argv[optind]);
+        perror("Unable to run the command");
+        _exit(127);
+    }
+
+    //**** Record ****
+    int rtn = 0;
+    printf("Recording CPUs %s to %s while running %s (pid %d)\n", cpu_list, path, argv[optind], pid);
+
+    struct timespec next;
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    int status = 0;
+    uint64_t num_samples = 0;
+    while(rtn == 0){
+        pid_t done = waitpid(pid, &status, WNOHANG);
+        if(done == pid){
+            break;
+        }else if(done < 0){
+            perror("Unable to wait for the command");
+            rtn = 1;
+            break;
+        }
+
+        uint64_t time_ns = sir_time_ns();
+        //Samples taken while the command is starting up are not recorded
+        if(time_ns >= record_time_ns){
+            if(sir_read_all(fd, reports, num_cpus) < 0){
+                perror("Unable to read the counters");
+                kill(pid, SIGTERM);
+                rtn = 1;
+                break;
+            }
+            for(int cpu = 0; cpu<num_cpus && cpu<CPU_SETSIZE; cpu++){
+                if(CPU_ISSET(cpu, &cpus) && sir_trace_append(&writer, &encoders[cpu], time_ns, &reports[cpu]) != 0){
+                    kill(pid, SIGTERM);
+                    rtn = 1;
+                    break;
+                }
+            }
+            num_samples++;
+        }
+
+        add_ns(&next, period_us*1000);
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+    }
+
+    if(rtn != 0){
+        waitpid(pid, &status, 0);
+    }
+
+    //**** Finish the Profile ****
+    for(int cpu = 0; cpu<num_cpus && cpu<CPU_SETSIZE; cpu++){
+        if(CPU_ISSET(cpu, &cpus) && sir_trace_flush(&writer, &encoders[cpu]) != 0){
+            rtn = 1;
+        }
+    }
+    if(sir_trace_writer_close(&writer) != 0){
+        rtn = 1;
+    }
+    for(int cpu = 0; cpu<num_cpus && cpu<CPU_SETSIZE; cpu++){
+        if(CPU_ISSET(cpu, &cpus)){
+            sir_trace_encoder_free(&encoders[cpu]);
+        }
+    }
+
+    if(WIFEXITED(status)){
+        printf("Command exited with status %d after %.3f s (%lu samples)\n", WEXITSTATUS(status), (sir_time_ns() - start_time_ns)/1e9, num_samples);
+        if(WEXITSTATUS(status) != 0){
+            printf("Warning: The command failed, the profile may not be representative\n");
+        }
+    }else if(WIFSIGNALED(status)){
+        printf("Command was killed by signal %d after %.3f s (%lu samples)\n", WTERMSIG(status), (sir_time_ns() - start_time_ns)/1e9, num_samples);
+    }
+
+    free(reports);
+    free(encoders);
+    close(fd);
+
+    return rtn;
+}
+
+//==== Compare ====
+
+//Loads the per-window counts of every class for each CPU in a profile
+static int load_profile(profile_t* profile, const char* path, uint64_t window_ns){
+    sir_trace_reader_t reader;
+    if(sir_trace_reader_open(&reader, path) != 0){
+        return -1;
+    }
+
+    memset(profile, 0, sizeof(profile_t));
+    profile->path = path;
+    profile->window_ns = window_ns;
+
+    uint64_t start_time_ns = reader.header->start_time_ns;
+    uint64_t end_time_ns = start_time_ns;
+    for(uint64_t i = 0; i<reader.num_chunks; i++){
+        if((int) reader.index[i].cpu + 1 > profile->num_cpus){
+            profile->num_cpus = reader.index[i].cpu + 1;
+        }
+        if(reader.index[i].last_time_ns > end_time_ns){
+            end_time_ns = reader.index[i].last_time_ns;
+        }
+        if(reader.index[i].first_time_ns < start_time_ns){
+            start_time_ns = reader.index[i].first_time_ns;
+        }
+    }
+    profile->num_windows = (end_time_ns - start_time_ns)/window_ns + 1;
+    profile->duration_s = (end_time_ns - start_time_ns)/1e9;
+
+    profile->cpus = (profile_cpu_t*) calloc(profile->num_cpus > 0 ? profile->num_cpus : 1, sizeof(profile_cpu_t));
+    if(profile->cpus == NULL){
+        printf("Unable to allocate CPU state\n");
+        sir_trace_reader_close(&reader);
+        return -1;
+    }
+
+    for(uint64_t i = 0; i<reader.num_chunks; i++){
+        profile_cpu_t* state = &profile->cpus[reader.index[i].cpu];
+        if(state->counts == NULL){
+            state->counts = (uint64_t*) calloc(NUM_CLASSES*profile->num_windows, sizeof(uint64_t));
+            if(state->counts == NULL){
+                printf("Unable to allocate window state\n");
+                sir_trace_reader_close(&reader);
+                return -1;
+            }
+        }
+    }
+
+    //Chunks from a given CPU are written in time order
+    for(uint64_t i = 0; i<reader.num_chunks; i++){
+        sir_trace_cursor_t cursor;
+        profile_cpu_t* state = &profile->cpus[reader.index[i].cpu];
+        uint64_t time_ns;
+        struct sir_report report;
+        int status;
+
+        if(sir_trace_cursor_init(&reader, i, &cursor) != 0){
+            printf("Warning: Skipping corrupt chunk %lu in %s\n", i, path);
+            continue;
+        }
+
+        while((status = sir_trace_cursor_next(&cursor, &time_ns, &report)) > 0){
+            SIR_INTERRUPT_TYPE vals[SIR_REPORT_NUM_FIELDS];
+            uint64_t window = (time_ns - start_time_ns)/window_ns;
+            sir_report_to_array(&report, vals);
+
+            if(!state->seen){
+                state->seen = 1;
+                state->first_window = window;
+            }else{
+                for(size_t j = 0; j<SIR_REPORT_NUM_FIELDS; j++){
+                    SIR_INTERRUPT_TYPE delta = sir_counter_delta((int) j, vals[j], state->last[j]);
+                    state->counts[j*profile->num_windows + window] += delta;
+                    if(j >= SIR_REPORT_FIRST_SOFTIRQ){
+                        state->counts[CLASS_SOFTIRQ*profile->num_windows + window] += delta;
+                    }else if(j == 0 || j == SIR_REPORT_ARCH_SUM){
+                        state->counts[CLASS_IRQ*profile->num_windows + window] += delta;
+                    }
+                }
+            }
+
+            memcpy(state->last, vals, sizeof(vals));
+            state->last_window = window;
+        }
+
+        if(status < 0){
+            printf("Warning: Chunk %lu in %s is corrupt, remaining samples in the chunk skipped\n", i, path);
+        }
+    }
+
+    sir_trace_reader_close(&reader);
+
+    return 0;
+}
+
+static void free_profile(profile_t* profile){
+    for(int cpu = 0; cpu<profile->num_cpus; cpu++){
+        free(profile->cpus[cpu].counts);
+    }
+    free(profile->cpus);
+}
+
+//Returns the per-window counts of a class for a CPU.  The first and last
+//windows only cover part of a window and are excluded.
+static uint64_t profile_windows(const profile_t* profile, int cpu, int class, const uint64_t** counts){
+    const profile_cpu_t* state = &profile->cpus[cpu];
+    if(state->last_window < state->first_window + 2){
+        *counts = NULL;
+        return 0;
+    }
+    *counts = state->counts + class*profile->num_windows + state->first_window + 1;
+    return state->last_window - state->first_window - 1;
+}
+
+static int compare_double(const void* a, const void* b){
+    double va = *((const double*) a);
+    double vb = *((const double*) b);
+    return (va > vb) - (va < vb);
+}
+
+static int compare_ranked(const void* a, const void* b){
+    return compare_double(&((const ranked_t*) a)->val, &((const ranked_t*) b)->val);
+}
+
+//Computes the mean, the given percentile (nearest rank), and the max of the
+//per-window counts, scaled to per second
+static void class_stats(const uint64_t* counts, uint64_t n, double percentile, uint64_t window_ns, double* sorted, class_stats_t* stats){
+    double sum = 0;
+    double scale = 1e9/window_ns;
+
+    memset(stats, 0, sizeof(class_stats_t));
+    stats->n = n;
+    if(n == 0){
+        return;
+    }
+
+    for(uint64_t i = 0; i<n; i++){
+        sorted[i] = counts[i];
+        sum += counts[i];
+    }
+    qsort(sorted, n, sizeof(double), compare_double);
+
+    uint64_t rank = (uint64_t) ceil(percentile/100*n);
+    rank = rank == 0 ? 1 : rank;
+    stats->mean = sum/n*scale;
+    stats->pct = sorted[(rank > n ? n : rank) - 1]*scale;
+    stats->max = sorted[n-1]*scale;
+}
+
+//Two-sided Mann-Whitney U test of whether the per-window counts of the two
+//profiles come from the same distribution.  Uses the normal approximation
+//with the correction for ties (the counts are discrete so ties are common).
+//Returns the p-value.
+static double mann_whitney(const uint64_t* a, uint64_t n_a, const uint64_t* b, uint64_t n_b, ranked_t* ranked){
+    uint64_t n = n_a + n_b;
+    double rank_sum_a = 0;
+    double tie_sum = 0;
+
+    if(n_a == 0 || n_b == 0){
+        return 1;
+    }
+
+    for(uint64_t i = 0; i<n_a; i++){
+        ranked[i].val = a[i];
+        ranked[i].group = 0;
+    }
+    for(uint64_t i = 0; i<n_b; i++){
+        ranked[n_a+i].val = b[i];
+        ranked[n_a+i].group = 1;
+    }
+    qsort(ranked, n, sizeof(ranked_t), compare_ranked);
+
+    //Tied values share the average of their ranks
+    for(uint64_t i = 0; i<n;){
+        uint64_t j = i;
+        while(j < n && ranked[j].val == ranked[i].val){
+            j++;
+        }
+        double rank = (i + 1 + j)/2.0;
+        double ties = j - i;
+        for(uint64_t k = i; k<j; k++){
+            if(ranked[k].group == 0){
+                rank_sum_a += rank;
+            }
+        }
+        tie_sum += ties*ties*ties - ties;
+        i = j;
+    }
+
+    double u = rank_sum_a - n_a*(n_a+1)/2.0;
+    double mean_u = n_a*(double) n_b/2;
+    double var_u = n_a*(double) n_b/12*((n+1) - tie_sum/(n*(double) (n-1)));
+    if(var_u <= 0){
+        return 1; //Every window has the same count
+    }
+
+    double z = fabs(u - mean_u)/sqrt(var_u);
+    return erfc(z/sqrt(2));
+}
+
+//One-sided test of whether the candidate has more windows at or above the baseline's
+//burst percentile than the baseline does (normal approximation to the binomial).
+//Returns the p-value.
+static double tail_test(const uint64_t* a, uint64_t n_a, const uint64_t* b, uint64_t n_b, double limit){
+    uint64_t above_a = 0;
+    uint64_t above_b = 0;
+
+    if(n_a == 0 || n_b == 0){
+        return 1;
+    }
+    //Windows with no interrupts are never bursts
+    limit = limit < 1 ? 1 : limit;
+    for(uint64_t i = 0; i<n_a; i++){
+        above_a += a[i] >= limit;
+    }
+    for(uint64_t i = 0; i<n_b; i++){
+        above_b += b[i] >= limit;
+    }
+
+    //A baseline with no windows at or above the limit is treated as having half of one
+    double p0 = (above_a > 0 ? above_a : 0.5)/n_a;
+    if(p0 >= 1){
+        return 1;
+    }
+    double z = (above_b - n_b*p0)/sqrt(n_b*p0*(1-p0));
+    return 0.5*erfc(z/sqrt(2));
+}
+
+static int compare_profiles(int argc, char* argv[]){
+    double window_ms = 100;
+    double percentile = 99;
+    double threshold = 0.1;
+    double alpha = 0.01;
+    double min_rate = 1;
+    int verbose = 0;
+    int opt;
+
+    //**** Parse Arguments ****
+    optind = 1;
+    while((opt = getopt(argc, argv, "w:q:t:s:m:vh")) != -1){
+        switch(opt){
+            case 'w':
+                window_ms = atof(optarg);
+                break;
+            case 'q':
+                percentile = atof(optarg);
+                break;
+            case 't':
+                threshold = atof(optarg)/100;
+                break;
+            case 's':
+                alpha = atof(optarg);
+                break;
+            case 'm':
+                min_rate = atof(optarg);
+                break;
+            case 'v':
+                verbose = 1;
+                break;
+            default:
+                return -1;
+        }
+    }
+
+    if(optind + 2 > argc || window_ms <= 0 || percentile <= 0 || percentile > 100){
+        printf("Error: Missing or invalid arguments\n\n");
+        return -1;
+    }
+
+    uint64_t window_ns = (uint64_t) (window_ms*1e6);
+    if(window_ns == 0){
+        window_ns = 1;
+    }
+
+    profile_t base;
+    profile_t cand;
+    if(load_profile(&base, argv[optind], window_ns) != 0){
+        return 1;
+    }
+    if(load_profile(&cand, argv[optind+1], window_ns) != 0){
+        free_profile(&base);
+        return 1;
+    }
+
+    uint64_t max_windows = base.num_windows > cand.num_windows ? base.num_windows : cand.num_windows;
+    double* sorted = (double*) malloc(max_windows*sizeof(double));
+    ranked_t* ranked = (ranked_t*) malloc((base.num_windows + cand.num_windows)*sizeof(ranked_t));
+    if(sorted == NULL || ranked == NULL){
+        printf("Unable to allocate comparison state\n");
+        exit(1);
+    }
+
+    printf("Baseline:  %s (%.3f s)\n", base.path, base.duration_s);
+    printf("Candidate: %s (%.3f s)\n", cand.path, cand.duration_s);
+    printf("Window: %.3f ms, Burst percentile: p%g, Threshold: %.1f%%, Significance: %g, Minimum change: %.1f/s\n",
+           window_ms, percentile, threshold*100, alpha, min_rate);
+
+    //**** Compare ****
+    int num_regressions = 0;
+    int num_improvements = 0;
+    int num_cpus = base.num_cpus > cand.num_cpus ? base.num_cpus : cand.num_cpus;
+    for(int cpu = 0; cpu<num_cpus; cpu++){
+        int in_base = cpu < base.num_cpus && base.cpus[cpu].seen;
+        int in_cand = cpu < cand.num_cpus && cand.cpus[cpu].seen;
+        if(!in_base && !in_cand){
+            continue;
+        }
+        if(!in_base || !in_cand){
+            printf("\nCPU %d: only in the %s profile, not compared\n", cpu, in_base ? "baseline" : "candidate");
+            continue;
+        }
+
+        printf("\nCPU %d:\n", cpu);
+        printf("\t%-18s %12s %12s %9s %12s %12s %9s %10s\n", "class", "base/s", "cand/s", "change", "base p", "cand p", "p-value", "");
+
+        //Totals first, then the individual classes
+        for(int i = 0; i<(int) NUM_CLASSES; i++){
+            int class = i < 2 ? (int) CLASS_IRQ + i : i - 2;
+            const uint64_t* base_counts;
+            const uint64_t* cand_counts;
+            class_stats_t base_stats;
+            class_stats_t cand_stats;
+
+            if(class == SIR_REPORT_ARCH_SUM){
+                continue; //The sum of the x86 classes (included in irq)
+            }
+
+            uint64_t n_base = profile_windows(&base, cpu, class, &base_counts);
+            uint64_t n_cand = profile_windows(&cand, cpu, class, &cand_counts);
+            if(n_base == 0 || n_cand == 0){
+                if(class == CLASS_IRQ){
+                    printf("\tProfile too short for a %.3f ms window\n", window_ms);
+                }
+                break;
+            }
+
+            class_stats(base_counts, n_base, percentile, window_ns, sorted, &base_stats);
+            class_stats(cand_counts, n_cand, percentile, window_ns, sorted, &cand_stats);
+            if(base_stats.max == 0 && cand_stats.max == 0){
+                continue;
+            }
+
+            double p = mann_whitney(base_counts, n_base, cand_counts, n_cand, ranked);
+            double p_tail = tail_test(base_counts, n_base, cand_counts, n_cand, base_stats.pct*window_ns/1e9);
+            double mean_change = cand_stats.mean - base_stats.mean;
+            double pct_change = cand_stats.pct - base_stats.pct;
+            const char* verdict = "";
+
+            //A change in the mean rate must be significant in the rank test.  A
+            //few large bursts do not move the rank test so a change in the burst
+            //percentile is checked separately against how often the candidate
+            //exceeds the baseline's percentile.
+            if(mean_change > threshold*base_stats.mean && mean_change >= min_rate && p < alpha){
+                verdict = "REGRESSION";
+            }else if(pct_change > threshold*base_stats.pct && pct_change >= min_rate && p_tail < alpha){
+                verdict = "BURSTS";
+            }else if(-mean_change > threshold*base_stats.mean && -mean_change >= min_rate && p < alpha){
+                verdict = "improved";
+            }
+
+            if(verdict[0] == 'R' || verdict[0] == 'B'){
+                num_regressions++;
+            }else if(verdict[0] == 'i'){
+                num_improvements++;
+            }else if(!verbose && class != CLASS_IRQ && class != CLASS_SOFTIRQ){
+                continue;
+            }
+
+            char change[16];
+            if(base_stats.mean > 0){
+                snprintf(change, sizeof(change), "%+.1f%%", mean_change/base_stats.mean*100);
+            }else{
+                snprintf(change, sizeof(change), "new");
+            }
+            printf("\t%-18s %12.1f %12.1f %9s %12.1f %12.1f %9.2g %10s\n", class_name(class), base_stats.mean, cand_stats.mean,
+                   change, base_stats.pct, cand_stats.pct, verdict[0] == 'B' ? p_tail : p, verdict);
+        }
+    }
+
+    printf("\n%d regression(s), %d improvement(s)\n", num_regressions, num_improvements);
+
+    free(sorted);
+    free(ranked);
+    free_profile(&base);
+    free_profile(&cand);
+
+    return num_regressions > 0 ? 2 : 0;
+}
+
+void print_help()
+{
+    printf("Usage:\n");
+    printf("\tsir_ab run -o PROFILE -c CPUS [-a CMD_CPUS] [-s SAMPLER_CPU] [-p PERIOD_US] [-w SETTLE_S] -- COMMAND [ARGS...]\n");
+    printf("\t\t-o PROFILE = Profile (trace) file to write\n");
+    printf("\t\t-c CPUS = CPUs to sample (ex. 2-15)\n");
+    printf("\t\t-a CMD_CPUS = CPUs to pin the command to (default: not pinned)\n");
+    printf("\t\t-s SAMPLER_CPU = CPU to pin the sampler to (default: not pinned, should be a housekeeping CPU)\n");
+    printf("\t\t-p PERIOD_US = Sampling period in microseconds (default 1000)\n");
+    printf("\t\t-w SETTLE_S = Time to let the command start before recording (default 0)\n");
+    printf("\tsir_ab compare [-w WINDOW_MS] [-q PERCENTILE] [-t THRESHOLD_PCT] [-s ALPHA] [-m MIN_RATE] [-v] BASELINE CANDIDATE\n");
+    printf("\t\t-w WINDOW_MS = Window the per-window counts are taken over (default 100)\n");
+    printf("\t\t-q PERCENTILE = Percentile of the per-window counts used to compare bursts (default 99)\n");
+    printf("\t\t-t THRESHOLD_PCT = Increase (in percent) needed to flag a regression (default 10)\n");
+    printf("\t\t-s ALPHA = Significance level for flagging a change (default 0.01)\n");
+    printf("\t\t-m MIN_RATE = Smallest change (per second) which is flagged (default 1)\n");
+    printf("\t\t-v = List every class (by default only the totals and flagged classes are listed)\n");
+    printf("\tcompare returns 2 if any class regressed\n");
+}
+
+int main(int argc, char* argv[]){
+    int rtn;
+
+    if(argc < 2){
+        print_help();
+        return 1;
+    }
+
+    if(strcmp(argv[1], "run") == 0){
+        rtn = run_profile(argc-1, argv+1);
+    }else if(strcmp(argv[1], "compare") == 0){
+        rtn = compare_profiles(argc-1, argv+1);
+    }else{
+        rtn = strcmp(argv[1], "-h") == 0 ? 0 : -1;
+    }
+
+    if(rtn < 0){
+        print_help();
+        return 1;
+    }
+
+    return rtn;
+}
@@ -0,0 +1,486 @@
+/**
+ * Offline analyzer for trace files written by sir_record
+ *
+ * The trace is mapped and decoded in a single streaming pass.
+ * Only per-window counts are kept for each CPU so the memory
+ * used is proportional to the analyzed duration / window size
+ * rather than the number of samples.  For long traces, -s/-e
+ * restrict the analysis to a time range and the chunk index is
+ * used to skip the chunks outside of it.
+ *
+ * Reports:
+ *   * Per-CPU, per-class interrupt totals
+ *   * Per-window rates (optionally dumped as CSV)
+ *   * Bursts: windows with a count more than K standard
+ *     deviations above the CPU's mean window count
+ *   * Cross-CPU correlation of the per-window counts
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+
+#include "sir_trace.h"
+
+#define METRIC_IRQ -1
+#define METRIC_SOFTIRQ -2
+
+#define SIR_ANALYZE_MAX_WINDOW_BYTES (4ULL << 30)
+
+typedef struct
+{
+    int seen;
+    uint64_t samples;
+    uint64_t first_time_ns;
+    uint64_t last_time_ns;
+    SIR_INTERRUPT_TYPE last[SIR_REPORT_NUM_FIELDS];
+    SIR_INTERRUPT_TYPE totals[SIR_REPORT_NUM_FIELDS];
+
+    //Per-class accumulation for the window currently being processed
+    //Used to find the class which dominated each window
+    uint64_t cur_window;
+    SIR_INTERRUPT_TYPE cur_class[SIR_REPORT_NUM_FIELDS];
+
+    uint64_t first_window;
+    uint64_t last_window;
+    uint64_t* window_counts;
+    int8_t* window_dominant;
+
+    double window_mean;
+    double window_stddev;
+} cpu_state_t;
+
+typedef struct
+{
+    int cpu_a;
+    int cpu_b;
+    double r;
+} correlation_t;
+
+static SIR_INTERRUPT_TYPE metric_delta(int metric, const SIR_INTERRUPT_TYPE* delta){
+    if(metric == METRIC_IRQ){
+        return delta[0] + delta[SIR_REPORT_ARCH_SUM];
+    }else if(metric == METRIC_SOFTIRQ){
+        SIR_INTERRUPT_TYPE sum = 0;
+        for(size_t i = SIR_REPORT_FIRST_SOFTIRQ; i<SIR_REPORT_NUM_FIELDS; i++){
+            sum += delta[i];
+        }
+        return sum;
+    }
+    return delta[metric];
+}
+
+//Records the class which contributed the most to the window which just closed
+static void close_window(cpu_state_t* state){
+    int dominant = -1;
+    SIR_INTERRUPT_TYPE max = 0;
+    for(size_t i = 0; i<SIR_REPORT_NUM_FIELDS; i++){
+        //arch_irq_stat_sum is the sum of the other x86 classes
+        if(i != SIR_REPORT_ARCH_SUM && state->cur_class[i] > max){
+            max = state->cur_class[i];
+            dominant = i;
+        }
+    }
+    state->window_dominant[state->cur_window] = (int8_t) dominant;
+    memset(state->cur_class, 0, sizeof(state->cur_class));
+}
+
+static int compare_correlation(const void* a, const void* b){
+    double ra = fabs(((const correlation_t*) a)->r);
+    double rb = fabs(((const correlation_t*) b)->r);
+    return (ra < rb) - (ra > rb);
+}
+
+static const char* metric_name(int metric){
+    if(metric == METRIC_IRQ){
+        return "irq";
+    }else if(metric == METRIC_SOFTIRQ){
+        return "softirq";
+    }
+    return sir_report_field_names[metric];
+}
+
+void print_help()
+{
+    printf("Usage: sir_analyze [-w WINDOW_MS] [-s START_S] [-e END_S] [-f FIELD] [-k SIGMA] [-b MAX_BURSTS] [-t CORR] [-r] FILE\n");
+    printf("\t-w WINDOW_MS = Window size in milliseconds (default 100)\n");
+    printf("\t-s START_S = Only analyze samples from START_S seconds after the trace started (default 0)\n");
+    printf("\t-e END_S = Only analyze samples up to END_S seconds after the trace started (default: end of trace)\n");
+    printf("\t-f FIELD = Counter to analyze: irq, softirq, or a sir_report field name (default irq)\n");
+    printf("\t-k SIGMA = Burst threshold in standard deviations above the mean window count (default 3)\n");
+    printf("\t-b MAX_BURSTS = Maximum number of bursts to list per CPU (default 10)\n");
+    printf("\t-t CORR = Minimum |correlation| of CPU pairs to report (default 0.5)\n");
+    printf("\t-r = Print the per-window rates as CSV\n");
+}
+
+int main(int argc, char* argv[]){
+    double window_ms = 100;
+    double sigma = 3;
+    int max_bursts = 10;
+    double corr_threshold = 0.5;
+    int print_rates = 0;
+    int metric = METRIC_IRQ;
+    double range_start_s = 0;
+    double range_end_s = 0;
+    int opt;
+
+    //**** Parse Arguments ****
+    while((opt = getopt(argc, argv, "w:s:e:f:k:b:t:rh")) != -1){
+        switch(opt){
+            case 'w':
+                window_ms = atof(optarg);
+                break;
+            case 's':
+                range_start_s = atof(optarg);
+                break;
+            case 'e':
+                range_end_s = atof(optarg);
+                break;
+            case 'f':
+                if(strcmp(optarg, "irq") == 0){
+                    metric = METRIC_IRQ;
+                }else if(strcmp(optarg, "softirq") == 0){
+                    metric = METRIC_SOFTIRQ;
+                }else{
+                    metric = sir_report_field_index(optarg);
+                    if(metric < 0){
+                        printf("Error: Unknown field: %s\n", optarg);
+                        return 1;
+                    }
+                }
+                break;
+            case 'k':
+                sigma = atof(optarg);
+                break;
+            case 'b':
+                max_bursts = atoi(optarg);
+                break;
+            case 't':
+                corr_threshold = atof(optarg);
+                break;
+            case 'r':
+                print_rates = 1;
+                break;
+            default:
+                print_help();
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    if(optind >= argc || window_ms <= 0 || range_start_s < 0 || (range_end_s > 0 && range_end_s <= range_start_s)){
+        printf("Error: No trace file supplied\n\n");
+        print_help();
+        return 1;
+    }
+
+    sir_trace_reader_t reader;
+    if(sir_trace_reader_open(&reader, argv[optind]) != 0){
+        return 1;
+    }
+
+    //**** Size the Per-CPU State from the Index ****
+    uint64_t window_ns = (uint64_t) (window_ms*1e6);
+    if(window_ns == 0){
+        window_ns = 1;
+    }
+    //Chunks entirely outside of the range are skipped using the index
+    uint64_t range_start_ns = reader.header->start_time_ns + (uint64_t) (range_start_s*1e9);
+    uint64_t range_end_ns = range_end_s > 0 ? reader.header->start_time_ns + (uint64_t) (range_end_s*1e9) : UINT64_MAX;
+    uint64_t start_time_ns = range_start_ns;
+    uint64_t end_time_ns = 0;
+    int num_cpus = 0;
+    uint64_t total_samples = 0;
+    for(uint64_t i = 0; i<reader.num_chunks; i++){
+        if(reader.index[i].last_time_ns < range_start_ns || reader.index[i].first_time_ns > range_end_ns){
+            continue;
+        }
+        if((int) reader.index[i].cpu + 1 > num_cpus){
+            num_cpus = reader.index[i].cpu + 1;
+        }
+        if(reader.index[i].last_time_ns > end_time_ns){
+            end_time_ns = reader.index[i].last_time_ns;
+        }
+    }
+    end_time_ns = end_time_ns > range_end_ns ? range_end_ns : end_time_ns;
+    if(num_cpus == 0 || end_time_ns < start_time_ns){
+        printf("No samples in the selected range\n");
+        sir_trace_reader_close(&reader);
+        return 1;
+    }
+    uint64_t num_windows = (end_time_ns - start_time_ns)/window_ns + 1;
+
+    //The per-window counts are kept in memory for the burst and correlation passes
+    if(num_windows*num_cpus*(sizeof(uint64_t)+sizeof(int8_t)) > SIR_ANALYZE_MAX_WINDOW_BYTES){
+        printf("Error: %lu windows for %d CPU(s) would use %lu MB, use a larger window (-w) or a range (-s/-e)\n",
+               num_windows, num_cpus, num_windows*num_cpus*(sizeof(uint64_t)+sizeof(int8_t)) >> 20);
+        sir_trace_reader_close(&reader);
+        return 1;
+    }
+
+    cpu_state_t* cpus = (cpu_state_t*) calloc(num_cpus > 0 ? num_cpus : 1, sizeof(cpu_state_t));
+    if(cpus == NULL){
+        printf("Unable to allocate CPU state\n");
+        exit(1);
+    }
+
+    for(uint64_t i = 0; i<reader.num_chunks; i++){
+        cpu_state_t* state;
+        if(reader.index[i].last_time_ns < range_start_ns || reader.index[i].first_time_ns > range_end_ns){
+            continue;
+        }
+        state = &cpus[reader.index[i].cpu];
+        if(state->window_counts == NULL){
+            state->window_counts = (uint64_t*) calloc(num_windows, sizeof(uint64_t));
+            state->window_dominant = (int8_t*) malloc(num_windows*sizeof(int8_t));
+            if(state->window_counts == NULL || state->window_dominant == NULL){
+                printf("Unable to allocate window state\n");
+                exit(1);
+            }
+            memset(state->window_dominant, -1, num_windows*sizeof(int8_t));
+        }
+    }
+
+    //**** Streaming Pass ****
+    //Chunks from a given CPU are written in time order so walking the index
+    //in file order visits each CPU's samples in order
+    for(uint64_t i = 0; i<reader.num_chunks; i++){
+        sir_trace_cursor_t cursor;
+        cpu_state_t* state;
+        uint64_t time_ns;
+        struct sir_report report;
+        int status;
+
+        if(reader.index[i].last_time_ns < range_start_ns || reader.index[i].first_time_ns > range_end_ns){
+            continue;
+        }
+        state = &cpus[reader.index[i].cpu];
+
+        if(sir_trace_cursor_init(&reader, i, &cursor) != 0){
+            printf("Warning: Skipping corrupt chunk %lu\n", i);
+            continue;
+        }
+
+        while((status = sir_trace_cursor_next(&cursor, &time_ns, &report)) > 0){
+            SIR_INTERRUPT_TYPE vals[SIR_REPORT_NUM_FIELDS];
+            uint64_t window;
+            if(time_ns < range_start_ns){
+                continue;
+            }else if(time_ns > range_end_ns){
+                break;
+            }
+            window = (time_ns - start_time_ns)/window_ns;
+            sir_report_to_array(&report, vals);
+
+            if(!state->seen){
+                state->seen = 1;
+                state->first_time_ns = time_ns;
+                state->first_window = window;
+                state->cur_window = window;
+            }else{
+                SIR_INTERRUPT_TYPE delta[SIR_REPORT_NUM_FIELDS];
+                for(size_t j = 0; j<SIR_REPORT_NUM_FIELDS; j++){
+                    delta[j] = sir_counter_delta(j, vals[j], state->last[j]);
+                    state->totals[j] += delta[j];
+                }
+
+                if(window != state->cur_window){
+                    close_window(state);
+                    state->cur_window = window;
+                }
+                for(size_t j = 0; j<SIR_REPORT_NUM_FIELDS; j++){
+                    state->cur_class[j] += delta[j];
+                }
+
+                state->window_counts[window] += metric_delta(metric, delta);
+            }
+
+            memcpy(state->last, vals, sizeof(vals));
+            state->last_time_ns = time_ns;
+            state->last_window = window;
+            state->samples++;
+        }
+
+        if(status < 0){
+            printf("Warning: Chunk %lu is corrupt, remaining samples in the chunk skipped\n", i);
+        }
+    }
+
+    for(int cpu = 0; cpu<num_cpus; cpu++){
+        if(cpus[cpu].seen){
+            close_window(&cpus[cpu]);
+        }
+    }
+
+    for(int cpu = 0; cpu<num_cpus; cpu++){
+        total_samples += cpus[cpu].samples;
+    }
+
+    //**** Summary ****
+    double duration_s = (end_time_ns - start_time_ns)/1e9;
+    printf("Trace: %s\n", argv[optind]);
+    printf("\tDuration: %.3f s, Chunks: %lu, Samples: %lu\n", duration_s, reader.num_chunks, total_samples);
+    printf("\tSize: %lu bytes (%.2f bytes/sample, %lu bytes/sample uncompressed)\n", reader.len, total_samples > 0 ? ((double) reader.len)/total_samples : 0.0, sizeof(struct sir_report));
+    printf("\tMetric: %s, Window: %.3f ms\n", metric_name(metric), window_ms);
+
+    //**** Per-Class Totals ****
+    printf("\nPer-Class Totals:\n");
+    for(int cpu = 0; cpu<num_cpus; cpu++){
+        cpu_state_t* state = &cpus[cpu];
+        if(!state->seen){
+            continue;
+        }
+        double cpu_duration_s = (state->last_time_ns - state->first_time_ns)/1e9;
+        printf("CPU %d (%lu samples, %.3f s):\n", cpu, state->samples, cpu_duration_s);
+        for(size_t j = 0; j<SIR_REPORT_NUM_FIELDS; j++){
+            if(state->totals[j] != 0){
+                printf("\t%s: %lu (%.1f/s)\n", sir_report_field_names[j], state->totals[j], cpu_duration_s > 0 ? state->totals[j]/cpu_duration_s : 0.0);
+            }
+        }
+    }
+
+    //**** Per-Window Rates ****
+    printf("\nPer-Window Rates (%s/s):\n", metric_name(metric));
+    for(int cpu = 0; cpu<num_cpus; cpu++){
+        cpu_state_t* state = &cpus[cpu];
+        if(!state->seen){
+            continue;
+        }
+
+        uint64_t n = state->last_window - state->first_window + 1;
+        uint64_t max = 0;
+        double sum = 0;
+        double sum_sq = 0;
+        for(uint64_t w = state->first_window; w<=state->last_window; w++){
+            uint64_t count = state->window_counts[w];
+            sum += count;
+            sum_sq += ((double) count)*count;
+            if(count > max){
+                max = count;
+            }
+        }
+        state->window_mean = sum/n;
+        state->window_stddev = sqrt(fmax(sum_sq/n - state->window_mean*state->window_mean, 0));
+
+        printf("\tCPU %d: Mean: %.1f, Std Dev: %.1f, Max: %.1f\n", cpu,
+               state->window_mean*1e9/window_ns, state->window_stddev*1e9/window_ns, max*1e9/window_ns);
+    }
+
+    if(print_rates){
+        printf("\ncpu,window_start_s,rate\n");
+        for(int cpu = 0; cpu<num_cpus; cpu++){
+            cpu_state_t* state = &cpus[cpu];
+            if(!state->seen){
+                continue;
+            }
+            for(uint64_t w = state->first_window; w<=state->last_window; w++){
+                printf("%d,%.6f,%.1f\n", cpu, range_start_s + w*window_ns/1e9, state->window_counts[w]*1e9/window_ns);
+            }
+        }
+    }
+
+    //**** Bursts ****
+    printf("\nBursts (> mean + %.1f std dev):\n", sigma);
+    for(int cpu = 0; cpu<num_cpus; cpu++){
+        cpu_state_t* state = &cpus[cpu];
+        if(!state->seen){
+            continue;
+        }
+
+        double threshold = state->window_mean + sigma*state->window_stddev;
+        int bursts = 0;
+        for(uint64_t w = state->first_window; w<=state->last_window; w++){
+            if(state->window_counts[w] > threshold && state->window_counts[w] > 0){
+                if(bursts < max_bursts){
+                    int dominant = state->window_dominant[w];
+                    printf("\tCPU %d @ %.6f s: %lu (dominant: %s)\n", cpu, range_start_s + w*window_ns/1e9, state->window_counts[w],
+                           dominant >= 0 ? sir_report_field_names[dominant] : "none");
+                }
+                bursts++;
+            }
+        }
+        if(bursts > max_bursts){
+            printf("\tCPU %d: %d more burst(s) not shown\n", cpu, bursts - max_bursts);
+        }
+    }
+
+    //**** Cross-CPU Correlation ****
+    //Pearson correlation of the per-window counts over the windows both CPUs were sampled in
+    printf("\nCross-CPU Correlation (|r| >= %.2f):\n", corr_threshold);
+    size_t num_pairs = 0;
+    size_t pairs_cap = 0;
+    correlation_t* pairs = NULL;
+    for(int a = 0; a<num_cpus; a++){
+        if(!cpus[a].seen){
+            continue;
+        }
+        for(int b = a+1; b<num_cpus; b++){
+            if(!cpus[b].seen){
+                continue;
+            }
+
+            uint64_t first = cpus[a].first_window > cpus[b].first_window ? cpus[a].first_window : cpus[b].first_window;
+            uint64_t last = cpus[a].last_window < cpus[b].last_window ? cpus[a].last_window : cpus[b].last_window;
+            if(last <= first){
+                continue;
+            }
+
+            double n = last - first + 1;
+            double sum_a = 0, sum_b = 0, sum_aa = 0, sum_bb = 0, sum_ab = 0;
+            for(uint64_t w = first; w<=last; w++){
+                double x = cpus[a].window_counts[w];
+                double y = cpus[b].window_counts[w];
+                sum_a += x;
+                sum_b += y;
+                sum_aa += x*x;
+                sum_bb += y*y;
+                sum_ab += x*y;
+            }
+            double cov = sum_ab - sum_a*sum_b/n;
+            double var_a = sum_aa - sum_a*sum_a/n;
+            double var_b = sum_bb - sum_b*sum_b/n;
+            if(var_a <= 0 || var_b <= 0){
+                continue;
+            }
+            double r = cov/sqrt(var_a*var_b);
+            if(fabs(r) < corr_threshold){
+                continue;
+            }
+
+            if(num_pairs == pairs_cap){
+                pairs_cap = pairs_cap == 0 ? 64 : pairs_cap*2;
+                pairs = (correlation_t*) realloc(pairs, pairs_cap*sizeof(correlation_t));
+                if(pairs == NULL){
+                    printf("Unable to allocate correlation results\n");
+                    exit(1);
+                }
+            }
+            pairs[num_pairs].cpu_a = a;
+            pairs[num_pairs].cpu_b = b;
+            pairs[num_pairs].r = r;
+            num_pairs++;
+        }
+    }
+
+    if(num_pairs > 0){
+        qsort(pairs, num_pairs, sizeof(correlation_t), compare_correlation);
+    }
+    for(size_t i = 0; i<num_pairs; i++){
+        printf("\tCPU %d <-> CPU %d: %.3f\n", pairs[i].cpu_a, pairs[i].cpu_b, pairs[i].r);
+    }
+    if(num_pairs == 0){
+        printf("\tNone\n");
+    }
+
+    //**** Cleanup ****
+    free(pairs);
+    for(int cpu = 0; cpu<num_cpus; cpu++){
+        free(cpus[cpu].window_counts);
+        free(cpus[cpu].window_dominant);
+    }
+    free(cpus);
+    sir_trace_reader_close(&reader);
+
+    return 0;
+}
@@ -0,0 +1,547 @@
+/**
+ * Exports sir counters in the OpenMetrics text format
+ *
+ * A collector thread reads the sir_report for every CPU using a single
+ * SIR_IOCTL_GET_ALL call per interval (no threads are pinned to the
+ * CPUs being measured) and renders the metrics text into the back half
+ * of a double buffer.  The server thread answers HTTP GET requests on a
+ * local socket with the most recently published buffer, so the cost of
+ * a scrape does not depend on the number of CPUs.
+ *
+ * Metric names follow the field names in sir.h.  The label cardinality is
+ * selected with -a:
+ *   cpu:    one series per CPU          (cpu="N")
+ *   cpuset: one series per named cpuset (cpuset="NAME"), defined with -g
+ *   total:  one series summed over all CPUs
+ * With -m class, the per-field families are replaced with sir_interrupts
+ * and sir_softirqs families which carry the field name in a class label.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sched.h>
+#include <signal.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "sir_util.h"
+
+#define SIR_EXPORTER_MAX_GROUPS 64
+#define SIR_EXPORTER_DEFAULT_SOCKET "/run/sir_exporter.sock"
+
+typedef enum {AGGREGATE_CPU, AGGREGATE_CPUSET, AGGREGATE_TOTAL} aggregate_t;
+typedef enum {LAYOUT_FIELD, LAYOUT_CLASS} layout_t;
+
+typedef struct
+{
+    char label[128];
+    cpu_set_t cpus;
+    SIR_INTERRUPT_TYPE sums[SIR_REPORT_NUM_FIELDS];
+} group_t;
+
+typedef struct
+{
+    char* data;
+    size_t len;
+    size_t cap;
+    pthread_rwlock_t lock;
+} render_buffer_t;
+
+typedef struct
+{
+    int fd;
+    int num_cpus;
+    struct sir_report* reports;
+    uint64_t interval_ns;
+    layout_t layout;
+    group_t* groups;
+    int num_groups;
+} collector_args_t;
+
+static render_buffer_t buffers[2];
+static atomic_int published = -1;
+static volatile sig_atomic_t stop_requested = 0;
+
+static void handle_stop(int sig){
+    stop_requested = 1;
+}
+
+//Only used to interrupt the collector's sleep on shutdown
+static void handle_wake(int sig){
+}
+
+//==== Rendering ====
+static void buffer_printf(render_buffer_t* buffer, const char* fmt, ...){
+    va_list args;
+    int len;
+
+    while(1){
+        va_start(args, fmt);
+        len = vsnprintf(buffer->data + buffer->len, buffer->cap - buffer->len, fmt, args);
+        va_end(args);
+        if(len < 0){
+            return;
+        }
+        if((size_t) len < buffer->cap - buffer->len){
+            buffer->len += len;
+            return;
+        }
+
+        size_t new_cap = buffer->cap*2 + len;
+        char* new_data = (char*) realloc(buffer->data, new_cap);
+        if(new_data == NULL){
+            printf("Unable to grow render buffer\n");
+            exit(1);
+        }
+        buffer->data = new_data;
+        buffer->cap = new_cap;
+    }
+}
+
+static void render_family(render_buffer_t* buffer, const char* family, const char* help){
+    buffer_printf(buffer, "# TYPE %s counter\n", family);
+    buffer_printf(buffer, "# HELP %s %s\n", family, help);
+}
+
+static void render(render_buffer_t* buffer, collector_args_t* args, double collection_s){
+    buffer->len = 0;
+
+    if(args->layout == LAYOUT_FIELD){
+        for(size_t field = 0; field<SIR_REPORT_NUM_FIELDS; field++){
+            char family[64];
+            snprintf(family, sizeof(family), "sir_%s", sir_report_field_names[field]);
+            render_family(buffer, family, sir_report_field_help[field]);
+            for(int g = 0; g<args->num_groups; g++){
+                buffer_printf(buffer, "%s_total%s %lu\n", family, args->groups[g].label, args->groups[g].sums[field]);
+            }
+        }
+    }else{
+        //arch_irq_stat_sum overlaps the individual x86 classes so it is kept in its own family
+        //to avoid double counting when the class series are summed
+        const char* families[] = {"sir_interrupts", "sir_arch_irq_stat_sum", "sir_softirqs"};
+        const char* helps[] = {"Interrupts by class", sir_report_field_help[SIR_REPORT_ARCH_SUM], "Softirqs by class"};
+        size_t starts[] = {0, SIR_REPORT_ARCH_SUM, SIR_REPORT_FIRST_SOFTIRQ};
+        size_t ends[] = {SIR_REPORT_ARCH_SUM, SIR_REPORT_FIRST_SOFTIRQ, SIR_REPORT_NUM_FIELDS};
+
+        for(int f = 0; f<3; f++){
+            render_family(buffer, families[f], helps[f]);
+            for(size_t field = starts[f]; field<ends[f]; field++){
+                for(int g = 0; g<args->num_groups; g++){
+                    //Splice the class label into the group's label set
+                    const char* label = args->groups[g].label;
+                    if(field == SIR_REPORT_ARCH_SUM){
+                        buffer_printf(buffer, "%s_total%s %lu\n", families[f], label, args->groups[g].sums[field]);
+                    }else if(label[0] == '\0'){
+                        buffer_printf(buffer, "%s_total{class=\"%s\"} %lu\n", families[f], sir_report_field_names[field], args->groups[g].sums[field]);
+                    }else{
+                        buffer_printf(buffer, "%s_total{class=\"%s\",%s %lu\n", families[f], sir_report_field_names[field], label+1, args->groups[g].sums[field]);
+                    }
+                }
+            }
+        }
+    }
+
+    buffer_printf(buffer, "# TYPE sir_exporter_collection_seconds gauge\n");
+    buffer_printf(buffer, "# HELP sir_exporter_collection_seconds Time taken to read and render the counters\n");
+    buffer_printf(buffer, "sir_exporter_collection_seconds %.9f\n", collection_s);
+    buffer_printf(buffer, "# EOF\n");
+}
+
+//==== Collector ====
+void* collector_thread(void* arg){
+    collector_args_t *args = (collector_args_t*) arg;
+    struct timespec next;
+
+    clock_gettime(CLOCK_MONOTONIC, &next);
+
+    while(!stop_requested){
+        uint64_t start_ns = sir_time_ns();
+        int back = atomic_load(&published) == 0 ? 1 : 0;
+
+        int num_reports = sir_read_all(args->fd, args->reports, args->num_cpus);
+        if(num_reports < 0){
+            perror("ioctl error");
+        }else{
+            for(int g = 0; g<args->num_groups; g++){
+                group_t* group = &(args->groups[g]);
+                memset(group->sums, 0, sizeof(group->sums));
+                for(int cpu = 0; cpu<num_reports; cpu++){
+                    if(CPU_ISSET(cpu, &(group->cpus))){
+                        SIR_INTERRUPT_TYPE vals[SIR_REPORT_NUM_FIELDS];
+                        sir_report_to_array(&(args->reports[cpu]), vals);
+                        for(size_t field = 0; field<SIR_REPORT_NUM_FIELDS; field++){
+                            group->sums[field] += vals[field];
+                        }
+                    }
+                }
+            }
+
+            //Wait for any scrape still sending the back buffer from the previous interval
+            pthread_rwlock_wrlock(&(buffers[back].lock));
+            render(&buffers[back], args, (sir_time_ns() - start_ns)/1e9);
+            pthread_rwlock_unlock(&(buffers[back].lock));
+            atomic_store(&published, back);
+        }
+
+        next.tv_nsec += args->interval_ns % 1000000000ULL;
+        next.tv_sec += args->interval_ns / 1000000000ULL;
+        if(next.tv_nsec >= 1000000000L){
+            next.tv_nsec -= 1000000000L;
+            next.tv_sec++;
+        }
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+    }
+
+    return NULL;
+}
+
+//==== Server ====
+static int send_all(int fd, const char* data, size_t len){
+    while(len > 0){
+        ssize_t sent = send(fd, data, len, MSG_NOSIGNAL);
+        if(sent < 0){
+            if(errno == EINTR){
+                continue;
+            }
+            return -1;
+        }
+        data += sent;
+        len -= sent;
+    }
+    return 0;
+}
+
+static void serve(int client){
+    char request[1024];
+    char header[256];
+    ssize_t len;
+    int idx;
+
+    //Only the request line is needed
+    len = recv(client, request, sizeof(request)-1, 0);
+    if(len <= 0){
+        return;
+    }
+    request[len] = '\0';
+
+    if(strncmp(request, "GET ", 4) != 0){
+        const char* rsp = "HTTP/1.0 405 Method Not Allowed\r\nContent-Length: 0\r\n\r\n";
+        send_all(client, rsp, strlen(rsp));
+        return;
+    }
+
+    idx = atomic_load(&published);
+    if(idx < 0){
+        const char* rsp = "HTTP/1.0 503 Service Unavailable\r\nContent-Length: 0\r\n\r\n";
+        send_all(client, rsp, strlen(rsp));
+        return;
+    }
+
+    pthread_rwlock_rdlock(&(buffers[idx].lock));
+    snprintf(header, sizeof(header),
+             "HTTP/1.0 200 OK\r\n"
+             "Content-Type: application/openmetrics-text; version=1.0.0; charset=utf-8\r\n"
+             "Content-Length: %lu\r\n\r\n", buffers[idx].len);
+    if(send_all(client, header, strlen(header)) == 0){
+        send_all(client, buffers[idx].data, buffers[idx].len);
+    }
+    pthread_rwlock_unlock(&(buffers[idx].lock));
+}
+
+static int open_listener(const char* socket_path, int port){
+    int listener;
+
+    if(port > 0){
+        struct sockaddr_in addr;
+        int one = 1;
+        listener = socket(AF_INET, SOCK_STREAM, 0);
+        if(listener < 0){
+            perror("Unable to create socket");
+            return -1;
+        }
+        setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if(bind(listener, (struct sockaddr*) &addr, sizeof(addr)) != 0){
+            perror("Unable to bind socket");
+            close(listener);
+            return -1;
+        }
+    }else{
+        struct sockaddr_un addr;
+        listener = socket(AF_UNIX, SOCK_STREAM, 0);
+        if(listener < 0){
+            perror("Unable to create socket");
+            return -1;
+        }
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        strncpy(addr.sun_path, socket_path, sizeof(addr.sun_path)-1);
+        unlink(socket_path);
+        if(bind(listener, (struct sockaddr*) &addr, sizeof(addr)) != 0){
+            perror("Unable to bind socket");
+            close(listener);
+            return -1;
+        }
+    }
+
+    if(listen(listener, 16) != 0){
+        perror("Unable to listen on socket");
+        close(listener);
+        return -1;
+    }
+
+    return listener;
+}
+
+void print_help()
+{
+    printf("Usage: sir_exporter [-s SOCKET | -p PORT] [-i INTERVAL_MS] [-a cpu|cpuset|total] [-g NAME=CPUS]... [-m field|class] [-c CPU]\n");
+    printf("\t-s SOCKET = Unix socket to serve metrics on (default %s)\n", SIR_EXPORTER_DEFAULT_SOCKET);
+    printf("\t-p PORT = Serve metrics on 127.0.0.1:PORT instead of a Unix socket\n");
+    printf("\t-i INTERVAL_MS = Collection interval in milliseconds (default 1000)\n");
+    printf("\t-a AGGREGATION = Series per CPU, per named cpuset, or in total (default cpu)\n");
+    printf("\t-g NAME=CPUS = Define a cpuset for -a cpuset (ex. rx=2-5)\n");
+    printf("\t-m LAYOUT = One metric family per sir_report field, or families with a class label (default field)\n");
+    printf("\t-c CPU = Pin the exporter to this (housekeeping) CPU\n");
+}
+
+int main(int argc, char* argv[]){
+    const char* socket_path = SIR_EXPORTER_DEFAULT_SOCKET;
+    int port = 0;
+    uint64_t interval_ms = 1000;
+    aggregate_t aggregate = AGGREGATE_CPU;
+    layout_t layout = LAYOUT_FIELD;
+    int pin_cpu = -1;
+    group_t* cpusets = (group_t*) calloc(SIR_EXPORTER_MAX_GROUPS, sizeof(group_t));
+    int num_cpusets = 0;
+    int opt;
+
+    if(cpusets == NULL){
+        printf("Unable to allocate cpusets\n");
+        return 1;
+    }
+
+    //**** Parse Arguments ****
+    while((opt = getopt(argc, argv, "s:p:i:a:g:m:c:h")) != -1){
+        switch(opt){
+            case 's':
+                socket_path = optarg;
+                break;
+            case 'p':
+                port = atoi(optarg);
+                break;
+            case 'i':
+                interval_ms = strtoull(optarg, NULL, 10);
+                break;
+            case 'a':
+                if(strcmp(optarg, "cpu") == 0){
+                    aggregate = AGGREGATE_CPU;
+                }else if(strcmp(optarg, "cpuset") == 0){
+                    aggregate = AGGREGATE_CPUSET;
+                }else if(strcmp(optarg, "total") == 0){
+                    aggregate = AGGREGATE_TOTAL;
+                }else{
+                    printf("Error: Unknown aggregation: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'g':{
+                char* eq = strchr(optarg, '=');
+                if(eq == NULL || eq == optarg || num_cpusets >= SIR_EXPORTER_MAX_GROUPS){
+                    printf("Error: Invalid cpuset: %s\n", optarg);
+                    return 1;
+                }
+                *eq = '\0';
+                if(sir_parse_cpu_list(eq+1, &(cpusets[num_cpusets].cpus)) != 0){
+                    printf("Error: Invalid CPU list for cpuset %s: %s\n", optarg, eq+1);
+                    return 1;
+                }
+                snprintf(cpusets[num_cpusets].label, sizeof(cpusets[num_cpusets].label), "{cpuset=\"%s\"}", optarg);
+                num_cpusets++;
+                break;
+            }
+            case 'm':
+                if(strcmp(optarg, "field") == 0){
+                    layout = LAYOUT_FIELD;
+                }else if(strcmp(optarg, "class") == 0){
+                    layout = LAYOUT_CLASS;
+                }else{
+                    printf("Error: Unknown layout: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'c':
+                pin_cpu = atoi(optarg);
+                break;
+            default:
+                print_help();
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    if(interval_ms == 0 || (aggregate == AGGREGATE_CPUSET && num_cpusets == 0)){
+        printf("Error: Missing or invalid arguments\n\n");
+        print_help();
+        return 1;
+    }
+
+    //**** Setup ****
+    if(pin_cpu >= 0){
+        cpu_set_t cpu_set;
+        CPU_ZERO(&cpu_set);
+        CPU_SET(pin_cpu, &cpu_set);
+        if(sched_setaffinity(0, sizeof(cpu_set), &cpu_set) != 0){
+            perror("Problem setting CPU affinity");
+            return 1;
+        }
+    }
+
+    collector_args_t args;
+    args.fd = open("/dev/sir0", O_RDONLY);
+    if(args.fd < 0){
+        perror("Unable to open /dev/sir0");
+        return 1;
+    }
+
+    args.num_cpus = sir_num_cpus(args.fd);
+    if(args.num_cpus <= 0){
+        perror("Unable to get the number of CPUs from sir");
+        return 1;
+    }
+    args.reports = (struct sir_report*) calloc(args.num_cpus, sizeof(struct sir_report));
+    args.interval_ns = interval_ms*1000000ULL;
+    args.layout = layout;
+
+    if(aggregate == AGGREGATE_CPUSET){
+        args.groups = cpusets;
+        args.num_groups = num_cpusets;
+    }else if(aggregate == AGGREGATE_TOTAL){
+        args.groups = cpusets;
+        args.num_groups = 1;
+        args.groups[0].label[0] = '\0';
+        CPU_ZERO(&(args.groups[0].cpus));
+        for(int cpu = 0; cpu<args.num_cpus && cpu<CPU_SETSIZE; cpu++){
+            CPU_SET(cpu, &(args.groups[0].cpus));
+        }
+    }else{
+        args.groups = (group_t*) calloc(args.num_cpus, sizeof(group_t));
+        args.num_groups = args.num_cpus;
+        if(args.groups == NULL){
+            printf("Unable to allocate CPU groups\n");
+            return 1;
+        }
+        for(int cpu = 0; cpu<args.num_cpus; cpu++){
+            snprintf(args.groups[cpu].label, sizeof(args.groups[cpu].label), "{cpu=\"%d\"}", cpu);
+            CPU_ZERO(&(args.groups[cpu].cpus));
+            CPU_SET(cpu, &(args.groups[cpu].cpus));
+        }
+    }
+
+    if(args.reports == NULL){
+        printf("Unable to allocate reports\n");
+        return 1;
+    }
+
+    for(int i = 0; i<2; i++){
+        buffers[i].cap = 64*1024;
+        buffers[i].len = 0;
+        buffers[i].data = (char*) malloc(buffers[i].cap);
+        if(buffers[i].data == NULL){
+            printf("Unable to allocate render buffer\n");
+            return 1;
+        }
+        pthread_rwlock_init(&(buffers[i].lock), NULL);
+    }
+
+    //SA_RESTART is not set so that accept returns on SIGINT/SIGTERM
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = handle_stop;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    sa.sa_handler = handle_wake;
+    sigaction(SIGUSR1, &sa, NULL);
+
+    int listener = open_listener(socket_path, port);
+    if(listener < 0){
+        return 1;
+    }
+
+    //**** Start Collector ****
+    //SIGINT/SIGTERM are blocked in the collector (which inherits the mask) so
+    //they are delivered to this thread and interrupt accept
+    sigset_t stop_signals;
+    sigemptyset(&stop_signals);
+    sigaddset(&stop_signals, SIGINT);
+    sigaddset(&stop_signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &stop_signals, NULL);
+
+    pthread_t collector;
+    int status = pthread_create(&collector, NULL, collector_thread, &args);
+    if(status != 0){
+        printf("Problem creating thread\n");
+        exit(1);
+    }
+
+    pthread_sigmask(SIG_UNBLOCK, &stop_signals, NULL);
+
+    if(port > 0){
+        printf("Serving metrics for %d CPU(s) on 127.0.0.1:%d\n", args.num_cpus, port);
+    }else{
+        printf("Serving metrics for %d CPU(s) on %s\n", args.num_cpus, socket_path);
+    }
+
+    //**** Serve ****
+    while(!stop_requested){
+        int client = accept(listener, NULL, NULL);
+        if(client < 0){
+            if(errno != EINTR){
+                perror("accept error");
+            }
+            continue;
+        }
+
+        //Do not let a stalled client block other scrapes indefinitely
+        struct timeval timeout = {1, 0};
+        setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+        serve(client);
+        close(client);
+    }
+
+    //**** Cleanup ****
+    pthread_kill(collector, SIGUSR1);
+    pthread_join(collector, NULL);
+    close(listener);
+    if(port <= 0){
+        unlink(socket_path);
+    }
+    close(args.fd);
+
+    for(int i = 0; i<2; i++){
+        free(buffers[i].data);
+        pthread_rwlock_destroy(&(buffers[i].lock));
+    }
+    if(args.groups != cpusets){
+        free(args.groups);
+    }
+    free(cpusets);
+    free(args.reports);
+
+    return 0;
+}
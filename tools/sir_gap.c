@@ -0,0 +1,492 @@
+/**
+ * Detects hidden latency on a CPU and classifies each stall
+ *
+ * A thread pinned to the CPU spins reading the TSC.  Whenever two
+ * consecutive reads are further apart than the resync threshold, the
+ * sir counters are read and compared against the previous read.  Gaps
+ * above the report threshold are classified by the counters which
+ * changed while the thread was stalled:
+ *
+ *   irq         = At least one hardware interrupt landed
+ *   softirq     = Only softirq counters changed
+ *   preempted   = The thread was context switched out
+ *   smi         = No counters changed but the SMI count MSR did (-s)
+ *   unexplained = Nothing changed (SMI, hypervisor exit, or firmware)
+ *
+ * The counters are re-read after every disturbance so the change
+ * only covers the stall itself and not earlier (shorter) interrupts.
+ * Interrupts too short to exceed the resync threshold are caught by
+ * also reading the cheap irq total (SIR_IOCTL_GET) on every spin and
+ * re-reading the counters when it changes.  The check is part of
+ * the measured spin, so stalls which land in the ioctl are still
+ * seen, and its typical (median) cost is calibrated at startup and
+ * subtracted from every gap.  With -q this check is skipped and the
+ * counts of those short interrupts are blamed on the next gap above
+ * the resync threshold.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sched.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+    #include <x86intrin.h>
+    #define SIR_HAVE_TSC
+#endif
+
+#include "sir_util.h"
+
+#define SIR_GAP_HIST_BUCKETS 40 //log2(ns) buckets
+#define SIR_GAP_MSR_SMI_COUNT 0x34 //MSR_SMI_COUNT (Intel)
+#define SIR_GAP_CHECK_SAMPLES 1001 //Spins used to calibrate the cost of the irq total check
+
+enum gap_class{
+    GAP_CLASS_IRQ,
+    GAP_CLASS_SOFTIRQ,
+    GAP_CLASS_PREEMPTED,
+    GAP_CLASS_SMI,
+    GAP_CLASS_UNEXPLAINED,
+    GAP_NUM_CLASSES
+};
+
+static const char* gap_class_names[] = {
+    "irq",
+    "softirq",
+    "preempted",
+    "smi",
+    "unexplained"
+};
+
+typedef struct
+{
+    uint64_t count;
+    uint64_t total_ns;
+    uint64_t max_ns;
+    uint64_t hist[SIR_GAP_HIST_BUCKETS];
+} gap_stats_t;
+
+typedef struct
+{
+    uint64_t time_ns;  //Time of the gap relative to the start of the run
+    uint64_t gap_ns;
+    int gap_class;
+    int dominant_field; //Field with the largest change (-1 if none)
+} gap_record_t;
+
+//A snapshot of everything which can explain a stall
+typedef struct
+{
+    SIR_INTERRUPT_TYPE vals[SIR_REPORT_NUM_FIELDS];
+    SIR_INTERRUPT_TYPE irq_total; //Same as SIR_IOCTL_GET
+    long ctx_switches;
+    uint64_t smi_count;
+} gap_snapshot_t;
+
+static volatile sig_atomic_t stop_requested = 0;
+
+static void handle_stop(int sig){
+    stop_requested = 1;
+}
+
+static inline uint64_t read_ticks(){
+    #ifdef SIR_HAVE_TSC
+        return __rdtsc();
+    #else
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+        return ((uint64_t) ts.tv_sec)*1000000000ULL + ts.tv_nsec;
+    #endif
+}
+
+//Returns the number of ticks per ns
+static double calibrate_ticks(){
+    #ifdef SIR_HAVE_TSC
+        uint64_t start_ns = sir_time_ns();
+        uint64_t start_ticks = read_ticks();
+        struct timespec wait = {0, 200000000L};
+        nanosleep(&wait, NULL);
+        uint64_t stop_ticks = read_ticks();
+        uint64_t stop_ns = sir_time_ns();
+        return ((double) (stop_ticks - start_ticks))/(stop_ns - start_ns);
+    #else
+        return 1.0;
+    #endif
+}
+
+static int take_snapshot(int sir_fd, int msr_fd, gap_snapshot_t* snapshot){
+    struct sir_report report;
+    struct rusage usage;
+
+    if(ioctl(sir_fd, SIR_IOCTL_GET_DETAILED, &report) < 0){
+        perror("ioctl error");
+        return -1;
+    }
+    sir_report_to_array(&report, snapshot->vals);
+    snapshot->irq_total = sir_report_irq_total(&report);
+
+    getrusage(RUSAGE_THREAD, &usage);
+    snapshot->ctx_switches = usage.ru_nvcsw + usage.ru_nivcsw;
+
+    snapshot->smi_count = 0;
+    if(msr_fd >= 0){
+        if(pread(msr_fd, &(snapshot->smi_count), sizeof(snapshot->smi_count), SIR_GAP_MSR_SMI_COUNT) != sizeof(snapshot->smi_count)){
+            snapshot->smi_count = 0;
+        }
+    }
+
+    return 0;
+}
+
+static int compare_u64(const void* a, const void* b){
+    uint64_t val_a = *((const uint64_t*) a);
+    uint64_t val_b = *((const uint64_t*) b);
+    if(val_a == val_b){
+        return 0;
+    }
+    return val_a < val_b ? -1 : 1;
+}
+
+//Returns the median number of ticks a spin with the irq total check takes
+//when nothing interrupts it.  Returns 0 on error.
+static uint64_t calibrate_check(int sir_fd){
+    uint64_t samples[SIR_GAP_CHECK_SAMPLES];
+
+    for(int i = 0; i<SIR_GAP_CHECK_SAMPLES; i++){
+        SIR_INTERRUPT_TYPE irq_total;
+        uint64_t start = read_ticks();
+        if(ioctl(sir_fd, SIR_IOCTL_GET, &irq_total) < 0){
+            perror("ioctl error");
+            return 0;
+        }
+        samples[i] = read_ticks() - start;
+    }
+
+    qsort(samples, SIR_GAP_CHECK_SAMPLES, sizeof(uint64_t), compare_u64);
+    return samples[SIR_GAP_CHECK_SAMPLES/2];
+}
+
+//Classifies a stall from the change in the snapshots.  dominant_field is set
+//to the counter with the largest change (-1 if no counter changed).
+static int classify_gap(const gap_snapshot_t* before, const gap_snapshot_t* after, int* dominant_field){
+    SIR_INTERRUPT_TYPE irq_delta = 0;
+    SIR_INTERRUPT_TYPE softirq_delta = 0;
+    SIR_INTERRUPT_TYPE max_delta = 0;
+
+    *dominant_field = -1;
+    for(size_t i = 0; i<SIR_REPORT_NUM_FIELDS; i++){
+        SIR_INTERRUPT_TYPE delta = sir_counter_delta((int) i, after->vals[i], before->vals[i]);
+        if(i == SIR_REPORT_ARCH_SUM){
+            continue; //Sum of the x86 fields
+        }
+        if(i >= SIR_REPORT_FIRST_SOFTIRQ){
+            softirq_delta += delta;
+        }else{
+            irq_delta += delta;
+        }
+        if(delta > max_delta){
+            max_delta = delta;
+            *dominant_field = i;
+        }
+    }
+
+    if(irq_delta > 0){
+        return GAP_CLASS_IRQ;
+    }else if(softirq_delta > 0){
+        return GAP_CLASS_SOFTIRQ;
+    }else if(after->ctx_switches != before->ctx_switches){
+        return GAP_CLASS_PREEMPTED;
+    }else if(after->smi_count != before->smi_count){
+        return GAP_CLASS_SMI;
+    }
+    return GAP_CLASS_UNEXPLAINED;
+}
+
+static void add_gap(gap_stats_t* stats, uint64_t gap_ns){
+    int bucket = 0;
+    while(bucket < SIR_GAP_HIST_BUCKETS-1 && (gap_ns >> (bucket+1)) != 0){
+        bucket++;
+    }
+
+    stats->count++;
+    stats->total_ns += gap_ns;
+    if(gap_ns > stats->max_ns){
+        stats->max_ns = gap_ns;
+    }
+    stats->hist[bucket]++;
+}
+
+//Returns the upper bound of the histogram bucket containing the percentile
+static uint64_t hist_percentile(const gap_stats_t* stats, double percentile){
+    uint64_t target = (uint64_t) (stats->count*percentile);
+    uint64_t seen = 0;
+    for(int bucket = 0; bucket<SIR_GAP_HIST_BUCKETS; bucket++){
+        seen += stats->hist[bucket];
+        if(seen > target){
+            return 1ULL << (bucket+1);
+        }
+    }
+    return stats->max_ns;
+}
+
+static void print_stats(const char* name, const gap_stats_t* stats, double duration_s, int print_hist){
+    if(stats->count == 0){
+        return;
+    }
+
+    printf("\t%s: %lu gaps (%.1f/s), stalled %.3f ms (%.4f%%), max %.1f us, p50 < %.1f us, p99 < %.1f us\n",
+           name, stats->count, stats->count/duration_s, stats->total_ns/1e6, stats->total_ns/(duration_s*1e7),
+           stats->max_ns/1e3, hist_percentile(stats, 0.5)/1e3, hist_percentile(stats, 0.99)/1e3);
+
+    if(print_hist){
+        for(int bucket = 0; bucket<SIR_GAP_HIST_BUCKETS; bucket++){
+            if(stats->hist[bucket] > 0){
+                printf("\t\t[%9.1f, %9.1f) us: %lu\n", (1ULL << bucket)/1e3, (1ULL << (bucket+1))/1e3, stats->hist[bucket]);
+            }
+        }
+    }
+}
+
+void print_help()
+{
+    printf("Usage: sir_gap -c CPU [-t THRESHOLD_NS] [-m RESYNC_NS] [-d DURATION_S] [-f PRIORITY] [-s] [-q] [-l MAX_GAPS]\n");
+    printf("\t-c CPU = CPU to spin on\n");
+    printf("\t-t THRESHOLD_NS = Report gaps at least this long (default 10000)\n");
+    printf("\t-m RESYNC_NS = Re-read the counters after any gap at least this long (default 500)\n");
+    printf("\t-d DURATION_S = Run duration in seconds (default: until SIGINT)\n");
+    printf("\t-f PRIORITY = Run with SCHED_FIFO at this priority to avoid being preempted\n");
+    printf("\t-s = Read the SMI count MSR (requires the msr module) to separate SMIs from hypervisor exits\n");
+    printf("\t-q = Do not check the irq total on every spin.  Spins faster but interrupts shorter than RESYNC_NS are blamed on the next gap\n");
+    printf("\t-l MAX_GAPS = List up to this many individual gaps\n");
+}
+
+int main(int argc, char* argv[]){
+    int cpu = -1;
+    uint64_t threshold_ns = 10000;
+    uint64_t resync_ns = 500;
+    double duration_s = 0;
+    int fifo_priority = 0;
+    int read_smi = 0;
+    int check_total = 1;
+    size_t max_gaps = 0;
+    int opt;
+
+    //**** Parse Arguments ****
+    while((opt = getopt(argc, argv, "c:t:m:d:f:sql:h")) != -1){
+        switch(opt){
+            case 'c':
+                cpu = atoi(optarg);
+                break;
+            case 't':
+                threshold_ns = strtoull(optarg, NULL, 10);
+                break;
+            case 'm':
+                resync_ns = strtoull(optarg, NULL, 10);
+                break;
+            case 'd':
+                duration_s = atof(optarg);
+                break;
+            case 'f':
+                fifo_priority = atoi(optarg);
+                break;
+            case 's':
+                read_smi = 1;
+                break;
+            case 'q':
+                check_total = 0;
+                break;
+            case 'l':
+                max_gaps = strtoul(optarg, NULL, 10);
+                break;
+            default:
+                print_help();
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    if(cpu < 0 || threshold_ns == 0 || resync_ns == 0 || resync_ns > threshold_ns){
+        printf("Error: Missing or invalid arguments\n\n");
+        print_help();
+        return 1;
+    }
+
+    //**** Setup ****
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    CPU_SET(cpu, &cpu_set);
+    if(sched_setaffinity(0, sizeof(cpu_set), &cpu_set) != 0){
+        perror("Problem setting CPU affinity");
+        return 1;
+    }
+
+    if(fifo_priority > 0){
+        struct sched_param param;
+        param.sched_priority = fifo_priority;
+        if(sched_setscheduler(0, SCHED_FIFO, &param) != 0){
+            perror("Problem setting SCHED_FIFO");
+            return 1;
+        }
+    }
+
+    int sir_fd = open("/dev/sir0", O_RDONLY);
+    if(sir_fd < 0){
+        perror("Unable to open /dev/sir0");
+        return 1;
+    }
+
+    int msr_fd = -1;
+    if(read_smi){
+        char msr_path[64];
+        snprintf(msr_path, sizeof(msr_path), "/dev/cpu/%d/msr", cpu);
+        msr_fd = open(msr_path, O_RDONLY);
+        if(msr_fd < 0){
+            perror("Unable to open the MSR device, SMIs will be reported as unexplained");
+        }
+    }
+
+    gap_record_t* gaps = NULL;
+    if(max_gaps > 0){
+        gaps = (gap_record_t*) calloc(max_gaps, sizeof(gap_record_t));
+        if(gaps == NULL){
+            printf("Unable to allocate gap list\n");
+            return 1;
+        }
+    }
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = handle_stop;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    double ticks_per_ns = calibrate_ticks();
+    uint64_t threshold_ticks = (uint64_t) (threshold_ns*ticks_per_ns);
+    uint64_t resync_ticks = (uint64_t) (resync_ns*ticks_per_ns);
+    uint64_t check_ticks = 0;
+    if(check_total){
+        check_ticks = calibrate_check(sir_fd);
+        if(check_ticks == 0){
+            return 1;
+        }
+    }
+
+    gap_stats_t class_stats[GAP_NUM_CLASSES];
+    gap_stats_t field_stats[SIR_REPORT_NUM_FIELDS];
+    memset(class_stats, 0, sizeof(class_stats));
+    memset(field_stats, 0, sizeof(field_stats));
+    size_t num_gaps = 0;
+    uint64_t resyncs = 0;
+
+    printf("Spinning on CPU %d (%.3f ticks/ns), reporting gaps >= %lu ns\n", cpu, ticks_per_ns, threshold_ns);
+    if(check_total){
+        printf("irq total check takes %.1f ns per spin (subtracted from each gap)\n", check_ticks/ticks_per_ns);
+    }
+
+    //**** Spin ****
+    gap_snapshot_t before;
+    gap_snapshot_t after;
+    if(take_snapshot(sir_fd, msr_fd, &before) != 0){
+        return 1;
+    }
+
+    uint64_t start_ticks = read_ticks();
+    uint64_t stop_ticks = duration_s > 0 ? start_ticks + (uint64_t) (duration_s*1e9*ticks_per_ns) : UINT64_MAX;
+    uint64_t prev = read_ticks();
+
+    while(!stop_requested){
+        SIR_INTERRUPT_TYPE irq_total = before.irq_total;
+        if(check_total && ioctl(sir_fd, SIR_IOCTL_GET, &irq_total) < 0){
+            perror("ioctl error");
+            break;
+        }
+
+        //The gap covers the whole spin, including the check, less its usual cost
+        uint64_t now = read_ticks();
+        uint64_t elapsed = now - prev;
+        uint64_t delta = elapsed > check_ticks ? elapsed - check_ticks : 0;
+
+        //If the irq total changed without a gap, the interrupt was too short to
+        //be one and the counters are re-read so it is not blamed on the next gap
+        if(delta >= resync_ticks || irq_total != before.irq_total){
+            if(take_snapshot(sir_fd, msr_fd, &after) != 0){
+                break;
+            }
+
+            if(delta >= threshold_ticks){
+                int dominant_field;
+                int gap_class = classify_gap(&before, &after, &dominant_field);
+                uint64_t gap_ns = (uint64_t) (delta/ticks_per_ns);
+
+                add_gap(&class_stats[gap_class], gap_ns);
+                for(size_t i = 0; i<SIR_REPORT_NUM_FIELDS; i++){
+                    if(i != SIR_REPORT_ARCH_SUM && after.vals[i] != before.vals[i]){
+                        add_gap(&field_stats[i], gap_ns);
+                    }
+                }
+
+                if(num_gaps < max_gaps){
+                    gaps[num_gaps].time_ns = (uint64_t) ((prev - start_ticks)/ticks_per_ns);
+                    gaps[num_gaps].gap_ns = gap_ns;
+                    gaps[num_gaps].gap_class = gap_class;
+                    gaps[num_gaps].dominant_field = dominant_field;
+                }
+                num_gaps++;
+            }
+
+            resyncs++;
+            before = after;
+            now = read_ticks(); //Do not count the time spent reading the counters
+        }
+
+        if(now >= stop_ticks){
+            break;
+        }
+        prev = now;
+    }
+
+    double run_s = (read_ticks() - start_ticks)/(ticks_per_ns*1e9);
+
+    //**** Report ****
+    printf("\nRan for %.3f s, %lu counter reads, %lu gaps >= %lu ns\n", run_s, resyncs, num_gaps, threshold_ns);
+
+    printf("\nBy class:\n");
+    for(int i = 0; i<GAP_NUM_CLASSES; i++){
+        print_stats(gap_class_names[i], &class_stats[i], run_s, 1);
+    }
+
+    printf("\nBy counter (a gap is counted for every counter which changed):\n");
+    for(size_t i = 0; i<SIR_REPORT_NUM_FIELDS; i++){
+        print_stats(sir_report_field_names[i], &field_stats[i], run_s, 0);
+    }
+
+    if(num_gaps > 0 && max_gaps > 0){
+        printf("\nGaps:\n");
+        for(size_t i = 0; i<num_gaps && i<max_gaps; i++){
+            printf("\t@ %.6f s: %.1f us, %s", gaps[i].time_ns/1e9, gaps[i].gap_ns/1e3, gap_class_names[gaps[i].gap_class]);
+            if(gaps[i].dominant_field >= 0){
+                printf(" (%s)", sir_report_field_names[gaps[i].dominant_field]);
+            }
+            printf("\n");
+        }
+    }
+
+    uint64_t unexplained = class_stats[GAP_CLASS_UNEXPLAINED].count + class_stats[GAP_CLASS_SMI].count;
+    if(num_gaps > 0){
+        printf("\n%.1f%% of gaps are explained by interrupts or softirqs (tune IRQ affinity), %.1f%% are not (check BIOS/SMI/hypervisor settings)\n",
+               100.0*(class_stats[GAP_CLASS_IRQ].count + class_stats[GAP_CLASS_SOFTIRQ].count)/num_gaps, 100.0*unexplained/num_gaps);
+    }
+
+    free(gaps);
+    if(msr_fd >= 0){
+        close(msr_fd);
+    }
+    close(sir_fd);
+
+    return 0;
+}
@@ -0,0 +1,129 @@
+/**
+ * Manages and reads named CPU groups in the sir module
+ *
+ * Groups are summed by the module so a single SIR_IOCTL_GROUP_GET
+ * call returns the total for every CPU in the group.  Groups are
+ * shared by all users of /dev/sir0 and remain registered until
+ * they are removed or the module is unloaded.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+
+#include "sir_util.h"
+
+void print_help()
+{
+    printf("Usage:\n");
+    printf("\tsir_group add NAME CPUS [smt] = Register a group (smt also adds the SMT siblings of each CPU)\n");
+    printf("\tsir_group remove NAME = Remove a group\n");
+    printf("\tsir_group get NAME [INTERVAL_MS] = Print the summed report for a group\n");
+    printf("\t                                   (or the rates over the interval if supplied)\n");
+}
+
+static int group_get(int fd, const char* name, struct sir_group_report* group_report){
+    memset(group_report, 0, sizeof(struct sir_group_report));
+    strncpy(group_report->name, name, SIR_GROUP_NAME_LEN-1);
+    if(ioctl(fd, SIR_IOCTL_GROUP_GET, group_report) < 0){
+        perror("Unable to read group");
+        return -1;
+    }
+    return 0;
+}
+
+int main(int argc, char* argv[]){
+    //**** Parse Arguments ****
+    if(argc < 3){
+        print_help();
+        return 1;
+    }
+
+    if(strlen(argv[2]) >= SIR_GROUP_NAME_LEN){
+        printf("Error: Group names are limited to %d characters\n", SIR_GROUP_NAME_LEN-1);
+        return 1;
+    }
+
+    int fd = open("/dev/sir0", O_RDONLY);
+    if(fd < 0){
+        perror("Unable to open /dev/sir0");
+        return 1;
+    }
+
+    int rtn = 0;
+    if(strcmp(argv[1], "add") == 0 && argc >= 4){
+        struct sir_group_def def;
+        cpu_set_t cpus;
+
+        if(sir_parse_cpu_list(argv[3], &cpus) != 0){
+            printf("Error: Invalid CPU list: %s\n", argv[3]);
+            close(fd);
+            return 1;
+        }
+
+        memset(&def, 0, sizeof(def));
+        strncpy(def.name, argv[2], SIR_GROUP_NAME_LEN-1);
+        for(int cpu = 0; cpu<SIR_GROUP_MAX_CPUS && cpu<CPU_SETSIZE; cpu++){
+            if(CPU_ISSET(cpu, &cpus)){
+                def.cpus[cpu/64] |= 1ULL << (cpu%64);
+            }
+        }
+        if(argc >= 5 && strcmp(argv[4], "smt") == 0){
+            def.flags |= SIR_GROUP_SMT_SIBLINGS;
+        }
+
+        if(ioctl(fd, SIR_IOCTL_GROUP_ADD, &def) < 0){
+            perror("Unable to add group");
+            rtn = 1;
+        }
+    }else if(strcmp(argv[1], "remove") == 0){
+        struct sir_group_def def;
+        memset(&def, 0, sizeof(def));
+        strncpy(def.name, argv[2], SIR_GROUP_NAME_LEN-1);
+        if(ioctl(fd, SIR_IOCTL_GROUP_REMOVE, &def) < 0){
+            perror("Unable to remove group");
+            rtn = 1;
+        }
+    }else if(strcmp(argv[1], "get") == 0){
+        struct sir_group_report start;
+        struct sir_group_report end;
+        SIR_INTERRUPT_TYPE start_vals[SIR_REPORT_NUM_FIELDS];
+        SIR_INTERRUPT_TYPE end_vals[SIR_REPORT_NUM_FIELDS];
+        double interval_s = argc >= 4 ? atof(argv[3])/1000 : 0;
+
+        memset(start_vals, 0, sizeof(start_vals));
+        if(interval_s > 0){
+            if(group_get(fd, argv[2], &start) != 0){
+                close(fd);
+                return 1;
+            }
+            sir_report_to_array(&(start.report), start_vals);
+            usleep((useconds_t) (interval_s*1e6));
+        }
+
+        if(group_get(fd, argv[2], &end) != 0){
+            close(fd);
+            return 1;
+        }
+        sir_report_to_array(&(end.report), end_vals);
+
+        printf("Group %s (%u online CPUs):\n", end.name, end.num_cpus);
+        for(size_t i = 0; i<SIR_REPORT_NUM_FIELDS; i++){
+            if(interval_s > 0){
+                printf("\t%s: %.1f/s\n", sir_report_field_names[i], sir_counter_delta((int) i, end_vals[i], start_vals[i])/interval_s);
+            }else{
+                printf("\t%s: %lu\n", sir_report_field_names[i], end_vals[i]);
+            }
+        }
+    }else{
+        print_help();
+        rtn = 1;
+    }
+
+    close(fd);
+
+    return rtn;
+}
@@ -0,0 +1,164 @@
+/**
+ * Lists which CPUs, tasks, and kernel functions are sending IPIs to a set of CPUs
+ *
+ * Requires the module to be loaded with ipi_attribution=1.  If an
+ * interval is given, the counts on this file handle are reset and
+ * only the IPIs sent during the interval are listed.  The tables
+ * have a fixed number of entries, so -x clears the tables of the
+ * CPUs (for every user) once the sources of interest have changed.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+
+#include "sir_util.h"
+
+#define SIR_IPI_MAX_ENTRIES 1024
+
+static const char* ipi_kind_names[] = {
+    "RES",
+    "CAL",
+    "TLB"
+};
+
+static int compare_entries(const void* a, const void* b){
+    const struct sir_ipi_entry* entry_a = (const struct sir_ipi_entry*) a;
+    const struct sir_ipi_entry* entry_b = (const struct sir_ipi_entry*) b;
+    uint64_t count_a = entry_a->ipis > entry_a->calls ? entry_a->ipis : entry_a->calls;
+    uint64_t count_b = entry_b->ipis > entry_b->calls ? entry_b->ipis : entry_b->calls;
+    if(count_a == count_b){
+        return 0;
+    }
+    return count_a < count_b ? 1 : -1;
+}
+
+void print_help()
+{
+    printf("Usage: sir_ipi [-i INTERVAL_MS] [-n TOP] [-x] CPUS\n");
+    printf("\tCPUS = Target CPUs to list (ex. 2-15)\n");
+    printf("\t-i INTERVAL_MS = Only count the IPIs sent during the interval (default: since the module was loaded)\n");
+    printf("\t-n TOP = Number of entries to list per CPU (default 20)\n");
+    printf("\t-x = Clear the tables of the CPUs and exit (removes the entries for every user)\n");
+}
+
+int main(int argc, char* argv[]){
+    double interval_ms = 0;
+    size_t top = 20;
+    int clear = 0;
+    int opt;
+
+    //**** Parse Arguments ****
+    while((opt = getopt(argc, argv, "i:n:xh")) != -1){
+        switch(opt){
+            case 'i':
+                interval_ms = atof(optarg);
+                break;
+            case 'n':
+                top = strtoul(optarg, NULL, 10);
+                break;
+            case 'x':
+                clear = 1;
+                break;
+            default:
+                print_help();
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    if(optind >= argc){
+        printf("Error: No CPUs Supplied\n\n");
+        print_help();
+        return 1;
+    }
+
+    cpu_set_t cpus;
+    if(sir_parse_cpu_list(argv[optind], &cpus) != 0){
+        printf("Error: Invalid CPU list: %s\n", argv[optind]);
+        return 1;
+    }
+
+    int fd = open("/dev/sir0", O_RDONLY);
+    if(fd < 0){
+        perror("Unable to open /dev/sir0");
+        return 1;
+    }
+
+    //**** Clear ****
+    if(clear){
+        for(int cpu = 0; cpu<CPU_SETSIZE; cpu++){
+            if(CPU_ISSET(cpu, &cpus) && ioctl(fd, SIR_IOCTL_IPI_CLEAR, &cpu) < 0){
+                perror(errno == ENODEV ? "IPI attribution is not enabled (load the module with ipi_attribution=1)" : "Unable to clear IPI counts");
+                close(fd);
+                return 1;
+            }
+        }
+        close(fd);
+        return 0;
+    }
+
+    struct sir_ipi_entry* entries = (struct sir_ipi_entry*) calloc(SIR_IPI_MAX_ENTRIES, sizeof(struct sir_ipi_entry));
+    if(entries == NULL){
+        printf("Unable to allocate entries\n");
+        close(fd);
+        return 1;
+    }
+
+    //**** Collect ****
+    if(interval_ms > 0){
+        int all_cpus = -1;
+        if(ioctl(fd, SIR_IOCTL_IPI_RESET, &all_cpus) < 0){
+            perror(errno == ENODEV ? "IPI attribution is not enabled (load the module with ipi_attribution=1)" : "Unable to reset IPI counts");
+            free(entries);
+            close(fd);
+            return 1;
+        }
+        usleep((useconds_t) (interval_ms*1000));
+    }
+
+    int rtn = 0;
+    for(int cpu = 0; cpu<CPU_SETSIZE; cpu++){
+        if(!CPU_ISSET(cpu, &cpus)){
+            continue;
+        }
+
+        struct sir_ipi_query query;
+        memset(&query, 0, sizeof(query));
+        query.cpu = cpu;
+        query.num_entries = SIR_IPI_MAX_ENTRIES;
+        query.entries = (uint64_t) (uintptr_t) entries;
+        if(ioctl(fd, SIR_IOCTL_IPI_GET, &query) < 0){
+            perror(errno == ENODEV ? "IPI attribution is not enabled (load the module with ipi_attribution=1)" : "Unable to read IPI counts");
+            rtn = 1;
+            break;
+        }
+
+        qsort(entries, query.num_entries, sizeof(struct sir_ipi_entry), compare_entries);
+
+        uint64_t total_ipis = 0;
+        for(uint32_t i = 0; i<query.num_entries; i++){
+            total_ipis += entries[i].ipis;
+        }
+
+        printf("CPU %d: %lu IPIs from %u sources", cpu, total_ipis, query.total_entries);
+        if(query.dropped > 0){
+            printf(" (%lu not attributed, table full, clear with -x)", query.dropped);
+        }
+        printf("\n");
+
+        for(uint32_t i = 0; i<query.num_entries && i<top; i++){
+            const char* kind = entries[i].kind < sizeof(ipi_kind_names)/sizeof(ipi_kind_names[0]) ? ipi_kind_names[entries[i].kind] : "?";
+            printf("\t%s %10lu IPIs %10lu calls  from CPU %3u %-16s %s\n", kind, entries[i].ipis, entries[i].calls,
+                   entries[i].src_cpu, entries[i].comm, entries[i].symbol);
+        }
+    }
+
+    free(entries);
+    close(fd);
+
+    return rtn;
+}
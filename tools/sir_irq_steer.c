@@ -0,0 +1,576 @@
+/**
+ * Moves IRQs off of isolated CPUs and verifies the result
+ *
+ * 1. Every IRQ in /proc/irq is pointed at the housekeeping CPUs by
+ *    writing smp_affinity_list.  IRQs which reject the write (per-CPU
+ *    and kernel managed IRQs) are reported as unmovable.
+ * 2. The interrupts which still land on the isolated CPUs are measured
+ *    over a soak window.  Per-IRQ counts come from /proc/interrupts,
+ *    which is read from this (housekeeping) CPU and does not disturb the
+ *    isolated CPUs.  The per-class totals on the isolated CPUs are
+ *    cross-checked with a single SIR_IOCTL_GET_ALL call at each end of
+ *    the window.
+ * 3. The IRQs and vectors which hit the isolated CPUs are listed,
+ *    sorted by rate.
+ *
+ * Returns 2 if any device IRQ (as opposed to a per-CPU vector such as
+ * LOC or RES) was still seen on the isolated CPUs.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sched.h>
+
+#include "sir_util.h"
+
+#define IRQ_LABEL_LEN 32
+#define IRQ_DESC_LEN 128
+
+typedef enum {IRQ_UNTOUCHED, IRQ_MOVED, IRQ_ALREADY_HOUSEKEEPING, IRQ_UNMOVABLE} irq_status_t;
+
+typedef struct
+{
+    int irq;
+    irq_status_t status;
+    int err;
+} irq_move_t;
+
+typedef struct
+{
+    char label[IRQ_LABEL_LEN];
+    char desc[IRQ_DESC_LEN];
+    uint64_t* counts; //Indexed by column in /proc/interrupts
+} irq_row_t;
+
+typedef struct
+{
+    int num_cols;
+    int col_cpu[CPU_SETSIZE]; //CPU number of each column
+    irq_row_t* rows;
+    int num_rows;
+} irq_table_t;
+
+typedef struct
+{
+    const irq_row_t* row;
+    uint64_t isolated_count;
+    irq_status_t status;
+    char cpus[256];
+} irq_hit_t;
+
+static const char* irq_status_names[] = {"", "moved", "already housekeeping", "unmovable"};
+
+//==== CPU Lists ====
+static void format_cpu_list(const cpu_set_t* cpus, char* buf, size_t len){
+    size_t pos = 0;
+    buf[0] = '\0';
+    for(int cpu = 0; cpu<CPU_SETSIZE && pos<len; cpu++){
+        if(!CPU_ISSET(cpu, cpus)){
+            continue;
+        }
+        int end = cpu;
+        while(end+1 < CPU_SETSIZE && CPU_ISSET(end+1, cpus)){
+            end++;
+        }
+        if(end == cpu){
+            pos += snprintf(buf+pos, len-pos, "%s%d", pos > 0 ? "," : "", cpu);
+        }else{
+            pos += snprintf(buf+pos, len-pos, "%s%d-%d", pos > 0 ? "," : "", cpu, end);
+        }
+        cpu = end;
+    }
+}
+
+static int read_cpu_list_file(const char* path, cpu_set_t* cpus){
+    char buf[4096];
+    FILE* file = fopen(path, "r");
+    if(file == NULL){
+        return -1;
+    }
+    if(fgets(buf, sizeof(buf), file) == NULL){
+        fclose(file);
+        return -1;
+    }
+    fclose(file);
+    buf[strcspn(buf, "\n")] = '\0';
+    return sir_parse_cpu_list(buf, cpus);
+}
+
+//==== Affinity ====
+static int compare_irq_move(const void* a, const void* b){
+    return ((const irq_move_t*) a)->irq - ((const irq_move_t*) b)->irq;
+}
+
+//Points every IRQ at the housekeeping CPUs.  Returns the number of IRQs found
+static int steer_irqs(const cpu_set_t* housekeeping, const cpu_set_t* isolated, int dry_run, irq_move_t** moves_out){
+    char housekeeping_list[4096];
+    DIR* dir;
+    struct dirent* entry;
+    irq_move_t* moves = NULL;
+    int num_moves = 0;
+    int cap = 0;
+
+    format_cpu_list(housekeeping, housekeeping_list, sizeof(housekeeping_list));
+
+    dir = opendir("/proc/irq");
+    if(dir == NULL){
+        perror("Unable to open /proc/irq");
+        *moves_out = NULL;
+        return 0;
+    }
+
+    while((entry = readdir(dir)) != NULL){
+        char path[512];
+        cpu_set_t current;
+        cpu_set_t overlap;
+
+        if(!isdigit((unsigned char) entry->d_name[0])){
+            continue;
+        }
+
+        if(num_moves == cap){
+            cap = cap == 0 ? 256 : cap*2;
+            moves = (irq_move_t*) realloc(moves, cap*sizeof(irq_move_t));
+            if(moves == NULL){
+                printf("Unable to allocate IRQ list\n");
+                exit(1);
+            }
+        }
+
+        irq_move_t* move = &moves[num_moves];
+        num_moves++;
+        move->irq = atoi(entry->d_name);
+        move->status = IRQ_UNTOUCHED;
+        move->err = 0;
+
+        snprintf(path, sizeof(path), "/proc/irq/%d/smp_affinity_list", move->irq);
+        if(read_cpu_list_file(path, &current) == 0){
+            CPU_AND(&overlap, &current, isolated);
+            if(CPU_COUNT(&overlap) == 0){
+                move->status = IRQ_ALREADY_HOUSEKEEPING;
+                continue;
+            }
+        }
+
+        if(dry_run){
+            continue;
+        }
+
+        int fd = open(path, O_WRONLY);
+        if(fd < 0 || write(fd, housekeeping_list, strlen(housekeeping_list)) < 0){
+            move->status = IRQ_UNMOVABLE;
+            move->err = errno;
+        }else{
+            move->status = IRQ_MOVED;
+        }
+        if(fd >= 0){
+            close(fd);
+        }
+
+        //The requested affinity can be accepted but not applied (ex. when the
+        //interrupt controller limits the number of targets)
+        snprintf(path, sizeof(path), "/proc/irq/%d/effective_affinity_list", move->irq);
+        if(move->status == IRQ_MOVED && read_cpu_list_file(path, &current) == 0){
+            CPU_AND(&overlap, &current, isolated);
+            if(CPU_COUNT(&overlap) > 0){
+                move->status = IRQ_UNMOVABLE;
+                move->err = 0;
+            }
+        }
+    }
+    closedir(dir);
+
+    qsort(moves, num_moves, sizeof(irq_move_t), compare_irq_move);
+    *moves_out = moves;
+    return num_moves;
+}
+
+static irq_status_t lookup_status(const irq_move_t* moves, int num_moves, const char* label){
+    char* end;
+    long irq = strtol(label, &end, 10);
+    if(end == label || *end != '\0'){
+        return IRQ_UNTOUCHED;
+    }
+    for(int i = 0; i<num_moves; i++){
+        if(moves[i].irq == irq){
+            return moves[i].status;
+        }
+    }
+    return IRQ_UNTOUCHED;
+}
+
+//==== /proc/interrupts ====
+static int read_interrupts(irq_table_t* table){
+    char* line = NULL;
+    size_t line_cap = 0;
+    int cap = 0;
+    FILE* file = fopen("/proc/interrupts", "r");
+    if(file == NULL){
+        perror("Unable to open /proc/interrupts");
+        return -1;
+    }
+
+    table->num_cols = 0;
+    table->rows = NULL;
+    table->num_rows = 0;
+
+    //Header: one column per online CPU
+    if(getline(&line, &line_cap, file) < 0){
+        fclose(file);
+        free(line);
+        return -1;
+    }
+    for(char* tok = strtok(line, " \t\n"); tok != NULL && table->num_cols<CPU_SETSIZE; tok = strtok(NULL, " \t\n")){
+        if(strncmp(tok, "CPU", 3) == 0){
+            table->col_cpu[table->num_cols] = atoi(tok+3);
+            table->num_cols++;
+        }
+    }
+
+    while(getline(&line, &line_cap, file) >= 0){
+        char* pos = line;
+        char* colon;
+
+        while(isspace((unsigned char) *pos)){
+            pos++;
+        }
+        colon = strchr(pos, ':');
+        if(colon == NULL){
+            continue;
+        }
+
+        if(table->num_rows == cap){
+            cap = cap == 0 ? 256 : cap*2;
+            table->rows = (irq_row_t*) realloc(table->rows, cap*sizeof(irq_row_t));
+            if(table->rows == NULL){
+                printf("Unable to allocate interrupt table\n");
+                exit(1);
+            }
+        }
+
+        irq_row_t* row = &(table->rows[table->num_rows]);
+        table->num_rows++;
+        *colon = '\0';
+        snprintf(row->label, sizeof(row->label), "%s", pos);
+        row->counts = (uint64_t*) calloc(table->num_cols > 0 ? table->num_cols : 1, sizeof(uint64_t));
+        if(row->counts == NULL){
+            printf("Unable to allocate interrupt table\n");
+            exit(1);
+        }
+
+        //Some rows (ex. ERR, MIS) only have a single global count
+        pos = colon+1;
+        for(int col = 0; col<table->num_cols; col++){
+            char* end;
+            unsigned long long val = strtoull(pos, &end, 10);
+            if(end == pos){
+                break;
+            }
+            row->counts[col] = val;
+            pos = end;
+        }
+
+        while(isspace((unsigned char) *pos)){
+            pos++;
+        }
+        pos[strcspn(pos, "\n")] = '\0';
+        snprintf(row->desc, sizeof(row->desc), "%s", pos);
+    }
+
+    free(line);
+    fclose(file);
+    return 0;
+}
+
+static void free_interrupts(irq_table_t* table){
+    for(int i = 0; i<table->num_rows; i++){
+        free(table->rows[i].counts);
+    }
+    free(table->rows);
+}
+
+static const irq_row_t* find_row(const irq_table_t* table, const char* label){
+    for(int i = 0; i<table->num_rows; i++){
+        if(strcmp(table->rows[i].label, label) == 0){
+            return &(table->rows[i]);
+        }
+    }
+    return NULL;
+}
+
+static int compare_hit(const void* a, const void* b){
+    uint64_t ca = ((const irq_hit_t*) a)->isolated_count;
+    uint64_t cb = ((const irq_hit_t*) b)->isolated_count;
+    return (ca < cb) - (ca > cb);
+}
+
+void print_help()
+{
+    printf("Usage: sir_irq_steer -i ISOLATED_CPUS [-k HOUSEKEEPING_CPUS] [-d SOAK_S] [-n] [-a]\n");
+    printf("\t-i ISOLATED_CPUS = CPUs to move interrupts away from (ex. 2-15)\n");
+    printf("\t-k HOUSEKEEPING_CPUS = CPUs to move interrupts to (default: online CPUs not in ISOLATED_CPUS)\n");
+    printf("\t-d SOAK_S = Time to measure the remaining interrupts over (default 10)\n");
+    printf("\t-n = Do not change any affinity, only verify\n");
+    printf("\t-a = Also set /proc/irq/default_smp_affinity so new IRQs start on the housekeeping CPUs\n");
+}
+
+int main(int argc, char* argv[]){
+    cpu_set_t isolated;
+    cpu_set_t housekeeping;
+    int have_isolated = 0;
+    int have_housekeeping = 0;
+    double soak_s = 10;
+    int dry_run = 0;
+    int set_default = 0;
+    int opt;
+
+    //**** Parse Arguments ****
+    while((opt = getopt(argc, argv, "i:k:d:nah")) != -1){
+        switch(opt){
+            case 'i':
+                if(sir_parse_cpu_list(optarg, &isolated) != 0){
+                    printf("Error: Invalid CPU list: %s\n", optarg);
+                    return 1;
+                }
+                have_isolated = 1;
+                break;
+            case 'k':
+                if(sir_parse_cpu_list(optarg, &housekeeping) != 0){
+                    printf("Error: Invalid CPU list: %s\n", optarg);
+                    return 1;
+                }
+                have_housekeeping = 1;
+                break;
+            case 'd':
+                soak_s = atof(optarg);
+                break;
+            case 'n':
+                dry_run = 1;
+                break;
+            case 'a':
+                set_default = 1;
+                break;
+            default:
+                print_help();
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    if(!have_isolated || soak_s <= 0){
+        printf("Error: Missing or invalid arguments\n\n");
+        print_help();
+        return 1;
+    }
+
+    if(!have_housekeeping){
+        if(read_cpu_list_file("/sys/devices/system/cpu/online", &housekeeping) != 0){
+            printf("Error: Unable to read the online CPUs\n");
+            return 1;
+        }
+        for(int cpu = 0; cpu<CPU_SETSIZE; cpu++){
+            if(CPU_ISSET(cpu, &isolated)){
+                CPU_CLR(cpu, &housekeeping);
+            }
+        }
+    }
+
+    cpu_set_t overlap;
+    CPU_AND(&overlap, &isolated, &housekeeping);
+    if(CPU_COUNT(&housekeeping) == 0 || CPU_COUNT(&overlap) > 0){
+        printf("Error: The housekeeping CPUs must be non-empty and must not include isolated CPUs\n");
+        return 1;
+    }
+
+    char list[4096];
+    format_cpu_list(&isolated, list, sizeof(list));
+    printf("Isolated CPUs: %s\n", list);
+    format_cpu_list(&housekeeping, list, sizeof(list));
+    printf("Housekeeping CPUs: %s\n", list);
+
+    //Run from a housekeeping CPU so this tool does not disturb the isolated CPUs
+    if(sched_setaffinity(0, sizeof(housekeeping), &housekeeping) != 0){
+        perror("Problem setting CPU affinity");
+    }
+
+    //**** Steer ****
+    if(set_default && !dry_run){
+        char mask[4096];
+        size_t pos = 0;
+        //default_smp_affinity only accepts a hex mask, most significant 32 bit word first
+        int words = (CPU_SETSIZE+31)/32;
+        int started = 0;
+        for(int w = words-1; w>=0 && pos<sizeof(mask); w--){
+            uint32_t word = 0;
+            for(int bit = 0; bit<32; bit++){
+                if(CPU_ISSET(w*32+bit, &housekeeping)){
+                    word |= 1U << bit;
+                }
+            }
+            if(word == 0 && !started && w > 0){
+                continue;
+            }
+            pos += snprintf(mask+pos, sizeof(mask)-pos, started ? ",%08x" : "%x", word);
+            started = 1;
+        }
+        FILE* file = fopen("/proc/irq/default_smp_affinity", "w");
+        if(file == NULL || fputs(mask, file) < 0 || fclose(file) != 0){
+            perror("Unable to set /proc/irq/default_smp_affinity");
+        }
+    }
+
+    irq_move_t* moves;
+    int num_moves = steer_irqs(&housekeeping, &isolated, dry_run, &moves);
+    int moved = 0, already = 0, unmovable = 0;
+    for(int i = 0; i<num_moves; i++){
+        if(moves[i].status == IRQ_MOVED){
+            moved++;
+        }else if(moves[i].status == IRQ_ALREADY_HOUSEKEEPING){
+            already++;
+        }else if(moves[i].status == IRQ_UNMOVABLE){
+            unmovable++;
+        }
+    }
+    printf("IRQs: %d, Moved: %d, Already on housekeeping CPUs: %d, Unmovable: %d\n", num_moves, moved, already, unmovable);
+    for(int i = 0; i<num_moves; i++){
+        if(moves[i].status == IRQ_UNMOVABLE){
+            printf("\tIRQ %d unmovable%s%s\n", moves[i].irq, moves[i].err ? ": " : " (effective affinity unchanged)", moves[i].err ? strerror(moves[i].err) : "");
+        }
+    }
+
+    //**** Soak ****
+    printf("\nMeasuring for %.1f s\n", soak_s);
+
+    int sir_fd = open("/dev/sir0", O_RDONLY);
+    int num_cpus = sir_fd >= 0 ? sir_num_cpus(sir_fd) : -1;
+    struct sir_report* sir_start = NULL;
+    struct sir_report* sir_end = NULL;
+    if(num_cpus > 0){
+        sir_start = (struct sir_report*) calloc(num_cpus, sizeof(struct sir_report));
+        sir_end = (struct sir_report*) calloc(num_cpus, sizeof(struct sir_report));
+    }
+    if(sir_start == NULL || sir_end == NULL){
+        printf("Warning: sir is not available, only /proc/interrupts will be used\n");
+        num_cpus = -1;
+    }
+
+    irq_table_t start, end;
+    if(read_interrupts(&start) != 0){
+        return 1;
+    }
+    if(num_cpus > 0 && sir_read_all(sir_fd, sir_start, num_cpus) < 0){
+        perror("ioctl error");
+        num_cpus = -1;
+    }
+
+    usleep((useconds_t) (soak_s*1e6));
+
+    if(num_cpus > 0 && sir_read_all(sir_fd, sir_end, num_cpus) < 0){
+        perror("ioctl error");
+        num_cpus = -1;
+    }
+    if(read_interrupts(&end) != 0){
+        return 1;
+    }
+
+    //**** Report ****
+    irq_hit_t* hits = (irq_hit_t*) calloc(end.num_rows > 0 ? end.num_rows : 1, sizeof(irq_hit_t));
+    int num_hits = 0;
+    int device_hits = 0;
+    if(hits == NULL){
+        printf("Unable to allocate results\n");
+        exit(1);
+    }
+
+    for(int i = 0; i<end.num_rows; i++){
+        const irq_row_t* row = &(end.rows[i]);
+        const irq_row_t* prev = find_row(&start, row->label);
+        cpu_set_t hit_cpus;
+        uint64_t isolated_count = 0;
+
+        CPU_ZERO(&hit_cpus);
+        for(int col = 0; col<end.num_cols; col++){
+            int cpu = end.col_cpu[col];
+            if(!CPU_ISSET(cpu, &isolated)){
+                continue;
+            }
+            //Columns are matched by CPU in case a CPU went on/offline during the soak
+            uint64_t before = 0;
+            if(prev != NULL){
+                for(int prev_col = 0; prev_col<start.num_cols; prev_col++){
+                    if(start.col_cpu[prev_col] == cpu){
+                        before = prev->counts[prev_col];
+                        break;
+                    }
+                }
+            }
+            if(row->counts[col] > before){
+                isolated_count += row->counts[col] - before;
+                CPU_SET(cpu, &hit_cpus);
+            }
+        }
+
+        if(isolated_count > 0){
+            hits[num_hits].row = row;
+            hits[num_hits].isolated_count = isolated_count;
+            hits[num_hits].status = lookup_status(moves, num_moves, row->label);
+            format_cpu_list(&hit_cpus, hits[num_hits].cpus, sizeof(hits[num_hits].cpus));
+            if(isdigit((unsigned char) row->label[0])){
+                device_hits++;
+            }
+            num_hits++;
+        }
+    }
+
+    qsort(hits, num_hits, sizeof(irq_hit_t), compare_hit);
+
+    printf("\nInterrupts on isolated CPUs (/proc/interrupts):\n");
+    for(int i = 0; i<num_hits; i++){
+        const char* status = irq_status_names[hits[i].status];
+        printf("\t%s: %.1f/s on CPU(s) %s [%s]%s%s%s\n", hits[i].row->label, hits[i].isolated_count/soak_s, hits[i].cpus, hits[i].row->desc,
+               status[0] != '\0' ? " (" : "", status, status[0] != '\0' ? ")" : "");
+    }
+    if(num_hits == 0){
+        printf("\tNone\n");
+    }
+
+    if(num_cpus > 0){
+        printf("\nPer-class rates on isolated CPUs (sir):\n");
+        for(int cpu = 0; cpu<num_cpus; cpu++){
+            SIR_INTERRUPT_TYPE before[SIR_REPORT_NUM_FIELDS];
+            SIR_INTERRUPT_TYPE after[SIR_REPORT_NUM_FIELDS];
+            if(!CPU_ISSET(cpu, &isolated)){
+                continue;
+            }
+            sir_report_to_array(&sir_start[cpu], before);
+            sir_report_to_array(&sir_end[cpu], after);
+            printf("\tCPU %d:", cpu);
+            int printed = 0;
+            for(size_t field = 0; field<SIR_REPORT_NUM_FIELDS; field++){
+                if(field != SIR_REPORT_ARCH_SUM && after[field] != before[field]){
+                    printf(" %s=%.1f/s", sir_report_field_names[field], sir_counter_delta((int) field, after[field], before[field])/soak_s);
+                    printed = 1;
+                }
+            }
+            printf("%s\n", printed ? "" : " None");
+        }
+    }
+
+    //**** Cleanup ****
+    if(sir_fd >= 0){
+        close(sir_fd);
+    }
+    free(sir_start);
+    free(sir_end);
+    free(hits);
+    free(moves);
+    free_interrupts(&start);
+    free_interrupts(&end);
+
+    return device_hits > 0 ? 2 : 0;
+}
@@ -0,0 +1,248 @@
+/**
+ * Records per-CPU sir_report samples to a compact trace file
+ *
+ * A sampling thread is pinned to each requested CPU and
+ * periodically calls SIR_IOCTL_GET_DETAILED.  Each thread
+ * delta encodes its own samples (see sir_trace.h) and
+ * writes completed chunks to the shared trace file.
+ *
+ * The trace can be analyzed with sir_analyze
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sched.h>
+#include <signal.h>
+#include <time.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+
+#include "sir_trace.h"
+
+typedef struct
+{
+    int cpu;
+    uint64_t period_ns;
+    uint64_t stop_time_ns;
+    uint32_t chunk_samples;
+    sir_trace_writer_t* writer;
+    int status;
+} record_thread_args_t;
+
+static volatile sig_atomic_t stop_requested = 0;
+
+static void handle_stop(int sig){
+    stop_requested = 1;
+}
+
+static void add_ns(struct timespec* ts, uint64_t ns){
+    ts->tv_nsec += ns % 1000000000ULL;
+    ts->tv_sec += ns / 1000000000ULL;
+    if(ts->tv_nsec >= 1000000000L){
+        ts->tv_nsec -= 1000000000L;
+        ts->tv_sec++;
+    }
+}
+
+void* record_thread(void* arg){
+    record_thread_args_t *args = (record_thread_args_t*) arg;
+    sir_trace_encoder_t encoder;
+    struct timespec next;
+    int fd;
+
+    args->status = -1;
+
+    //Each thread uses its own file handle to avoid contending on the per-file lock in sir
+    fd = open("/dev/sir0", O_RDONLY);
+    if(fd < 0){
+        perror("Unable to open /dev/sir0");
+        return NULL;
+    }
+
+    if(sir_trace_encoder_init(&encoder, args->cpu, args->chunk_samples) != 0){
+        close(fd);
+        return NULL;
+    }
+
+    args->status = 0;
+    clock_gettime(CLOCK_MONOTONIC, &next);
+
+    while(!stop_requested){
+        struct sir_report report;
+        uint64_t time_ns;
+
+        time_ns = sir_time_ns();
+        if(args->stop_time_ns != 0 && time_ns >= args->stop_time_ns){
+            break;
+        }
+
+        if(ioctl(fd, SIR_IOCTL_GET_DETAILED, &report) < 0){
+            perror("ioctl error");
+            args->status = -1;
+            break;
+        }
+
+        if(sir_trace_append(args->writer, &encoder, time_ns, &report) != 0){
+            args->status = -1;
+            break;
+        }
+
+        add_ns(&next, args->period_ns);
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+    }
+
+    if(sir_trace_flush(args->writer, &encoder) != 0){
+        args->status = -1;
+    }
+
+    sir_trace_encoder_free(&encoder);
+    close(fd);
+
+    return NULL;
+}
+
+void print_help()
+{
+    printf("Usage: sir_record -o FILE -c CPUS [-p PERIOD_US] [-d DURATION_S] [-n CHUNK_SAMPLES]\n");
+    printf("\t-o FILE = Trace file to write\n");
+    printf("\t-c CPUS = CPUs to sample (ex. 0-3,8)\n");
+    printf("\t-p PERIOD_US = Sampling period in microseconds (default 100)\n");
+    printf("\t-d DURATION_S = Recording duration in seconds (default: until SIGINT)\n");
+    printf("\t-n CHUNK_SAMPLES = Samples per chunk (default %d)\n", SIR_TRACE_DEFAULT_CHUNK_SAMPLES);
+}
+
+int main(int argc, char* argv[]){
+    const char* path = NULL;
+    const char* cpu_list = NULL;
+    uint64_t period_us = 100;
+    double duration_s = 0;
+    uint32_t chunk_samples = SIR_TRACE_DEFAULT_CHUNK_SAMPLES;
+    int opt;
+
+    //**** Parse Arguments ****
+    while((opt = getopt(argc, argv, "o:c:p:d:n:h")) != -1){
+        switch(opt){
+            case 'o':
+                path = optarg;
+                break;
+            case 'c':
+                cpu_list = optarg;
+                break;
+            case 'p':
+                period_us = strtoull(optarg, NULL, 10);
+                break;
+            case 'd':
+                duration_s = atof(optarg);
+                break;
+            case 'n':
+                chunk_samples = strtoul(optarg, NULL, 10);
+                break;
+            default:
+                print_help();
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    if(path == NULL || cpu_list == NULL || period_us == 0){
+        printf("Error: Missing or invalid arguments\n\n");
+        print_help();
+        return 1;
+    }
+
+    cpu_set_t cpus;
+    if(sir_parse_cpu_list(cpu_list, &cpus) != 0){
+        printf("Error: Invalid CPU list: %s\n", cpu_list);
+        return 1;
+    }
+    int num_threads = CPU_COUNT(&cpus);
+
+    //**** Setup ****
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = handle_stop;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    uint64_t start_time_ns = sir_time_ns();
+    sir_trace_writer_t writer;
+    if(sir_trace_writer_open(&writer, path, start_time_ns) != 0){
+        return 1;
+    }
+
+    record_thread_args_t* args = (record_thread_args_t*) calloc(num_threads, sizeof(record_thread_args_t));
+    pthread_t* threads = (pthread_t*) calloc(num_threads, sizeof(pthread_t));
+    if(args == NULL || threads == NULL){
+        printf("Unable to allocate thread state\n");
+        exit(1);
+    }
+
+    //**** Start Threads ****
+    int thread = 0;
+    for(int cpu = 0; cpu<CPU_SETSIZE && thread<num_threads; cpu++){
+        if(!CPU_ISSET(cpu, &cpus)){
+            continue;
+        }
+
+        args[thread].cpu = cpu;
+        args[thread].period_ns = period_us*1000;
+        args[thread].stop_time_ns = duration_s > 0 ? start_time_ns + (uint64_t) (duration_s*1e9) : 0;
+        args[thread].chunk_samples = chunk_samples;
+        args[thread].writer = &writer;
+
+        pthread_attr_t pthread_attr;
+        cpu_set_t cpu_set;
+        int status = pthread_attr_init(&pthread_attr);
+        if(status != 0){
+            printf("Problem initializing pthread_attr\n");
+            exit(1);
+        }
+
+        CPU_ZERO(&cpu_set);
+        CPU_SET(cpu, &cpu_set);
+        status = pthread_attr_setaffinity_np(&pthread_attr, sizeof(cpu_set_t), &cpu_set);
+        if(status != 0){
+            printf("Problem setting thread CPU affinity\n");
+            exit(1);
+        }
+
+        status = pthread_create(&threads[thread], &pthread_attr, record_thread, &args[thread]);
+        if(status != 0){
+            printf("Problem creating thread\n");
+            exit(1);
+        }
+        pthread_attr_destroy(&pthread_attr);
+        thread++;
+    }
+
+    printf("Recording %d CPU(s) to %s\n", num_threads, path);
+
+    //**** Join Threads ****
+    int rtn = 0;
+    for(int i = 0; i<num_threads; i++){
+        int status = pthread_join(threads[i], NULL);
+        if(status != 0){
+            printf("Problem joining thread\n");
+            exit(1);
+        }
+        if(args[i].status != 0){
+            printf("Recording failed on CPU %d\n", args[i].cpu);
+            rtn = 1;
+        }
+    }
+
+    uint64_t num_chunks = writer.num_chunks;
+    uint64_t bytes = writer.offset;
+    if(sir_trace_writer_close(&writer) != 0){
+        rtn = 1;
+    }
+
+    printf("Wrote %lu chunk(s), %lu bytes\n", num_chunks, bytes + num_chunks*sizeof(struct sir_trace_index_entry));
+
+    free(args);
+    free(threads);
+
+    return rtn;
+}
@@ -0,0 +1,214 @@
+/**
+ * Attaches to a shared sampling session in the sir module and prints
+ * the per-CPU rates for each sampling period
+ *
+ * The session is created by the first user to attach with its name
+ * and is shared by every later user, so several instances (or other
+ * readers of the same session) see the same captures without the
+ * CPUs being read more than once per period.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+
+#include "sir_util.h"
+
+#define SIR_SESSION_READ_RECORDS 256
+
+//Returns the name of a field (sir_report fields followed by the totals)
+static const char* field_name(int idx){
+    if(idx == SIR_PMU_EVENT_IRQ_TOTAL){
+        return "irq_total";
+    }else if(idx == SIR_PMU_EVENT_SOFTIRQ_TOTAL){
+        return "softirq_total";
+    }
+    return sir_report_field_names[idx];
+}
+
+//Parses a comma separated list of field names into a field mask
+//Returns 0 on success and -1 if a field does not exist
+static int parse_fields(char* list, uint64_t* fields){
+    *fields = 0;
+    for(char* name = strtok(list, ","); name != NULL; name = strtok(NULL, ",")){
+        int idx = sir_report_field_index(name);
+        if(strcmp(name, "irq_total") == 0){
+            idx = SIR_PMU_EVENT_IRQ_TOTAL;
+        }else if(strcmp(name, "softirq_total") == 0){
+            idx = SIR_PMU_EVENT_SOFTIRQ_TOTAL;
+        }
+        if(idx < 0){
+            printf("Error: Unknown field: %s\n", name);
+            return -1;
+        }
+        *fields |= 1ULL << idx;
+    }
+    return 0;
+}
+
+void print_help()
+{
+    printf("Usage: sir_session [-c CPUS] [-f FIELDS] [-p PERIOD_US] [-n PERIODS] [-d DURATION_S] NAME\n");
+    printf("\tNAME = Session to attach to (created if it does not exist)\n");
+    printf("\t-c CPUS = CPUs to sample when creating the session (ex. 2-15)\n");
+    printf("\t-f FIELDS = Comma separated sir_report fields, irq_total, or softirq_total (default irq_total,softirq_total)\n");
+    printf("\t-p PERIOD_US = Sampling period when creating the session (default 1000)\n");
+    printf("\t-n PERIODS = Ring capacity in periods when creating the session (default %d)\n", SIR_SESSION_DEFAULT_PERIODS);
+    printf("\t-d DURATION_S = Time to print for (default until interrupted)\n");
+    printf("\tThe options other than -d are ignored when attaching to an existing session\n");
+}
+
+int main(int argc, char* argv[]){
+    struct sir_session_def def;
+    char* cpu_list = NULL;
+    double duration_s = 0;
+    int opt;
+
+    memset(&def, 0, sizeof(def));
+    def.fields = (1ULL << SIR_PMU_EVENT_IRQ_TOTAL) | (1ULL << SIR_PMU_EVENT_SOFTIRQ_TOTAL);
+    def.period_ns = 1000000;
+
+    //**** Parse Arguments ****
+    while((opt = getopt(argc, argv, "c:f:p:n:d:h")) != -1){
+        switch(opt){
+            case 'c':
+                cpu_list = optarg;
+                break;
+            case 'f':
+                if(parse_fields(optarg, &def.fields) != 0){
+                    return 1;
+                }
+                break;
+            case 'p':
+                def.period_ns = (uint64_t) (atof(optarg)*1000);
+                break;
+            case 'n':
+                def.periods = strtoul(optarg, NULL, 10);
+                break;
+            case 'd':
+                duration_s = atof(optarg);
+                break;
+            default:
+                print_help();
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    if(optind >= argc){
+        printf("Error: No Session Name Supplied\n\n");
+        print_help();
+        return 1;
+    }
+    if(strlen(argv[optind]) >= SIR_SESSION_NAME_LEN){
+        printf("Error: Session names are limited to %d characters\n", SIR_SESSION_NAME_LEN-1);
+        return 1;
+    }
+    strncpy(def.name, argv[optind], SIR_SESSION_NAME_LEN-1);
+
+    if(cpu_list != NULL){
+        cpu_set_t cpus;
+        if(sir_parse_cpu_list(cpu_list, &cpus) != 0){
+            printf("Error: Invalid CPU list: %s\n", cpu_list);
+            return 1;
+        }
+        for(int cpu = 0; cpu<SIR_GROUP_MAX_CPUS && cpu<CPU_SETSIZE; cpu++){
+            if(CPU_ISSET(cpu, &cpus)){
+                def.cpus[cpu/64] |= 1ULL << (cpu%64);
+            }
+        }
+    }
+
+    int fd = open("/dev/sir0", O_RDONLY);
+    if(fd < 0){
+        perror("Unable to open /dev/sir0");
+        return 1;
+    }
+
+    //**** Attach ****
+    if(ioctl(fd, SIR_IOCTL_SESSION_ATTACH, &def) < 0){
+        perror(errno == EINVAL && cpu_list == NULL ? "Unable to attach to session (use -c to create it)" : "Unable to attach to session");
+        close(fd);
+        return 1;
+    }
+
+    int field_idxs[SIR_PMU_EVENT_MAX];
+    int num_fields = 0;
+    for(int idx = 0; idx<SIR_PMU_EVENT_MAX; idx++){
+        if((def.fields >> idx) & 1){
+            field_idxs[num_fields++] = idx;
+        }
+    }
+
+    printf("Session %s: period %.1f us, %d fields, CPUs:", def.name, def.period_ns/1e3, num_fields);
+    for(int cpu = 0; cpu<SIR_GROUP_MAX_CPUS; cpu++){
+        if((def.cpus[cpu/64] >> (cpu%64)) & 1){
+            printf(" %d", cpu);
+        }
+    }
+    printf("\n");
+
+    //The previous record for each CPU is kept to compute the rates
+    char* records = (char*) malloc((size_t) SIR_SESSION_READ_RECORDS*def.record_size);
+    char* prev = (char*) calloc(SIR_GROUP_MAX_CPUS, def.record_size);
+    if(records == NULL || prev == NULL){
+        printf("Unable to allocate records\n");
+        close(fd);
+        return 1;
+    }
+
+    //**** Read ****
+    uint64_t stop_ns = sir_time_ns() + (uint64_t) (duration_s*1e9);
+    int rtn = 0;
+    while(duration_s <= 0 || sir_time_ns() < stop_ns){
+        struct sir_session_read read;
+        memset(&read, 0, sizeof(read));
+        read.max_records = SIR_SESSION_READ_RECORDS;
+        read.flags = SIR_SESSION_READ_WAIT;
+        read.buf = (uint64_t) (uintptr_t) records;
+        if(ioctl(fd, SIR_IOCTL_SESSION_READ, &read) < 0){
+            if(errno == EINTR){
+                break;
+            }
+            perror("Unable to read session");
+            rtn = 1;
+            break;
+        }
+
+        if(read.lost > 0){
+            printf("(%lu records lost)\n", read.lost);
+        }
+
+        for(uint32_t i = 0; i<read.num_records; i++){
+            struct sir_session_record* record = (struct sir_session_record*) (records + (size_t) i*read.record_size);
+            SIR_INTERRUPT_TYPE* vals = (SIR_INTERRUPT_TYPE*) (record+1);
+            struct sir_session_record* prev_record;
+            SIR_INTERRUPT_TYPE* prev_vals;
+
+            if(record->cpu >= SIR_GROUP_MAX_CPUS){
+                continue;
+            }
+            prev_record = (struct sir_session_record*) (prev + (size_t) record->cpu*read.record_size);
+            prev_vals = (SIR_INTERRUPT_TYPE*) (prev_record+1);
+
+            if(prev_record->time_ns != 0 && record->time_ns > prev_record->time_ns){
+                double interval_s = (record->time_ns - prev_record->time_ns)/1e9;
+                printf("%lu CPU %3u:", record->seq, record->cpu);
+                for(int j = 0; j<num_fields; j++){
+                    printf(" %s=%.1f/s", field_name(field_idxs[j]), sir_counter_delta(field_idxs[j], vals[j], prev_vals[j])/interval_s);
+                }
+                printf("\n");
+            }
+            memcpy(prev_record, record, read.record_size);
+        }
+    }
+
+    free(records);
+    free(prev);
+    close(fd); //Detaches from the session
+
+    return rtn;
+}
@@ -0,0 +1,167 @@
+/**
+ * Reports why the tick is not stopping on a set of (nohz_full) CPUs
+ *
+ * Reads the interrupt counters and tick state for every CPU with
+ * SIR_IOCTL_GET_ALL_TICK at the start and end of an interval and
+ * prints, per CPU, the local timer rate, whether the tick is stopped,
+ * when the next timer interrupt is due, and the dependencies which
+ * kept the tick running during the interval.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+
+#include "sir_util.h"
+
+static const char* tick_dep_names[SIR_TICK_NUM_DEPS] = {
+    "posix_timer",
+    "perf_events",
+    "sched",
+    "clock_unstable",
+    "rcu",
+    "rcu_exp",
+    "other",
+    "reserved"
+};
+
+static void print_dependency_mask(uint32_t mask){
+    int printed = 0;
+    for(int bit = 0; bit<SIR_TICK_DEP_OTHER; bit++){
+        if(mask & (1U << bit)){
+            printf("%s%s", printed ? "|" : "", tick_dep_names[bit]);
+            printed = 1;
+        }
+    }
+    if(!printed){
+        printf("none");
+    }
+}
+
+void print_help()
+{
+    printf("Usage: sir_tick [-i INTERVAL_MS] CPUS\n");
+    printf("\tCPUS = CPUs to report (ex. 2-15)\n");
+    printf("\t-i INTERVAL_MS = Interval to measure the tick and failure rates over (default 1000)\n");
+}
+
+int main(int argc, char* argv[]){
+    double interval_ms = 1000;
+    int opt;
+
+    //**** Parse Arguments ****
+    while((opt = getopt(argc, argv, "i:h")) != -1){
+        switch(opt){
+            case 'i':
+                interval_ms = atof(optarg);
+                break;
+            default:
+                print_help();
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    if(optind >= argc || interval_ms <= 0){
+        printf("Error: Missing or invalid arguments\n\n");
+        print_help();
+        return 1;
+    }
+
+    cpu_set_t cpus;
+    if(sir_parse_cpu_list(argv[optind], &cpus) != 0){
+        printf("Error: Invalid CPU list: %s\n", argv[optind]);
+        return 1;
+    }
+
+    int fd = open("/dev/sir0", O_RDONLY);
+    if(fd < 0){
+        perror("Unable to open /dev/sir0");
+        return 1;
+    }
+
+    int num_cpus = sir_num_cpus(fd);
+    if(num_cpus <= 0){
+        perror("Unable to get the number of CPUs");
+        close(fd);
+        return 1;
+    }
+
+    struct sir_tick_report* start = (struct sir_tick_report*) calloc(num_cpus, sizeof(struct sir_tick_report));
+    struct sir_tick_report* end = (struct sir_tick_report*) calloc(num_cpus, sizeof(struct sir_tick_report));
+    if(start == NULL || end == NULL){
+        printf("Unable to allocate reports\n");
+        close(fd);
+        return 1;
+    }
+
+    //**** Collect ****
+    if(sir_read_all_tick(fd, start, num_cpus) < 0){
+        perror("Unable to read the tick state");
+        close(fd);
+        return 1;
+    }
+    usleep((useconds_t) (interval_ms*1000));
+    if(sir_read_all_tick(fd, end, num_cpus) < 0){
+        perror("Unable to read the tick state");
+        close(fd);
+        return 1;
+    }
+    uint64_t now_ns = sir_time_ns();
+    double interval_s = interval_ms/1000;
+
+    //**** Report ****
+    for(int cpu = 0; cpu<num_cpus && cpu<CPU_SETSIZE; cpu++){
+        if(!CPU_ISSET(cpu, &cpus)){
+            continue;
+        }
+
+        struct sir_tick_state* tick = &(end[cpu].tick);
+        struct sir_tick_state* prev = &(start[cpu].tick);
+
+        printf("CPU %d%s: LOC %.1f/s", cpu, (tick->flags & SIR_TICK_NOHZ_FULL) ? " (nohz_full)" : "",
+               sir_counter_delta(2, end[cpu].report.irq_loc, start[cpu].report.irq_loc)/interval_s); //2 = irq_loc
+
+        if(tick->flags & SIR_TICK_STATE_VALID){
+            printf(", tick %s", (tick->flags & SIR_TICK_STOPPED) ? "stopped" : "running");
+        }
+        if(tick->flags & SIR_TICK_NEXT_VALID){
+            if(tick->next_event_ns == UINT64_MAX){
+                printf(", no timer pending");
+            }else{
+                printf(", next timer in %.1f us", ((double) ((int64_t) (tick->next_event_ns - now_ns)))/1e3);
+            }
+        }
+        printf("\n");
+
+        if(!(tick->flags & SIR_TICK_TRACKED)){
+            printf("\tTick stop tracking is not enabled (load the module with tick_tracking=1)\n");
+            continue;
+        }
+
+        printf("\tStops: %lu, Restarts: %lu, Failed stops: %lu (since load: %lu stops, %lu failed)\n",
+               tick->tick_stops - prev->tick_stops, tick->tick_restarts - prev->tick_restarts,
+               tick->stop_failures - prev->stop_failures, tick->tick_stops, tick->stop_failures);
+
+        if(tick->stop_failures != prev->stop_failures){
+            printf("\tKept running by:");
+            for(int dep = 0; dep<SIR_TICK_NUM_DEPS; dep++){
+                uint64_t count = tick->dependency_counts[dep] - prev->dependency_counts[dep];
+                if(count > 0){
+                    printf(" %s=%lu", tick_dep_names[dep], count);
+                }
+            }
+            printf("\n\tLast dependency: ");
+            print_dependency_mask(tick->last_dependency);
+            printf("\n");
+        }
+    }
+
+    free(start);
+    free(end);
+    close(fd);
+
+    return 0;
+}
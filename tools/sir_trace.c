@@ -0,0 +1,451 @@
+/**
+ * Compact binary trace format for recorded sir_report samples
+ *
+ * See sir_trace.h for a description of the format
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "sir_trace.h"
+
+_Static_assert(SIR_REPORT_NUM_FIELDS <= 64, "The changed field mask must fit in 64 bits");
+
+//==== Varint Helpers ====
+static uint8_t* put_varint(uint8_t* pos, uint64_t val){
+    while(val >= 0x80){
+        *pos = (uint8_t) (val | 0x80);
+        val >>= 7;
+        pos++;
+    }
+    *pos = (uint8_t) val;
+    return pos+1;
+}
+
+//Returns NULL if the varint runs past the end of the buffer or is too long
+static const uint8_t* get_varint(const uint8_t* pos, const uint8_t* end, uint64_t* val){
+    uint64_t result = 0;
+    int shift = 0;
+    while(pos < end && shift < 64){
+        uint8_t byte = *pos;
+        pos++;
+        result |= ((uint64_t) (byte & 0x7F)) << shift;
+        if((byte & 0x80) == 0){
+            *val = result;
+            return pos;
+        }
+        shift += 7;
+    }
+    return NULL;
+}
+
+//Counters in the kernel are mostly unsigned int and can wrap, so deltas are stored signed
+static uint64_t zigzag_encode(int64_t val){
+    return (((uint64_t) val) << 1) ^ (uint64_t) (val >> 63);
+}
+
+static int64_t zigzag_decode(uint64_t val){
+    return (int64_t) (val >> 1) ^ -((int64_t) (val & 1));
+}
+
+//==== Writer ====
+int sir_trace_writer_open(sir_trace_writer_t* writer, const char* path, uint64_t start_time_ns){
+    struct sir_trace_file_header header;
+
+    writer->file = fopen(path, "wb");
+    if(writer->file == NULL){
+        perror("Unable to open trace file");
+        return -1;
+    }
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SIR_TRACE_MAGIC, sizeof(header.magic));
+    header.version = SIR_TRACE_VERSION;
+    header.num_fields = SIR_REPORT_NUM_FIELDS;
+    header.start_time_ns = start_time_ns;
+
+    if(fwrite(&header, sizeof(header), 1, writer->file) != 1){
+        perror("Unable to write trace header");
+        fclose(writer->file);
+        return -1;
+    }
+
+    pthread_mutex_init(&(writer->lock), NULL);
+    writer->start_time_ns = start_time_ns;
+    writer->offset = sizeof(header);
+    writer->index = NULL;
+    writer->num_chunks = 0;
+    writer->index_cap = 0;
+
+    return 0;
+}
+
+int sir_trace_writer_close(sir_trace_writer_t* writer){
+    struct sir_trace_file_header header;
+    int rtn = 0;
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SIR_TRACE_MAGIC, sizeof(header.magic));
+    header.version = SIR_TRACE_VERSION;
+    header.num_fields = SIR_REPORT_NUM_FIELDS;
+    header.start_time_ns = writer->start_time_ns;
+    header.index_offset = writer->offset;
+    header.num_chunks = writer->num_chunks;
+
+    if(writer->num_chunks > 0 && fwrite(writer->index, sizeof(struct sir_trace_index_entry), writer->num_chunks, writer->file) != writer->num_chunks){
+        perror("Unable to write trace index");
+        rtn = -1;
+    }
+
+    //The header is only updated once the index is written so that an interrupted
+    //write leaves a trace which is recovered by scanning the chunks
+    if(rtn == 0){
+        if(fseek(writer->file, 0, SEEK_SET) != 0 || fwrite(&header, sizeof(header), 1, writer->file) != 1){
+            perror("Unable to update trace header");
+            rtn = -1;
+        }
+    }
+
+    if(fclose(writer->file) != 0){
+        perror("Unable to close trace file");
+        rtn = -1;
+    }
+
+    free(writer->index);
+    writer->index = NULL;
+    pthread_mutex_destroy(&(writer->lock));
+
+    return rtn;
+}
+
+int sir_trace_encoder_init(sir_trace_encoder_t* encoder, uint32_t cpu, uint32_t max_samples){
+    encoder->cpu = cpu;
+    encoder->num_samples = 0;
+    encoder->max_samples = max_samples > 0 ? max_samples : SIR_TRACE_DEFAULT_CHUNK_SAMPLES;
+    encoder->first_time_ns = 0;
+    encoder->prev_time_ns = 0;
+    memset(encoder->prev, 0, sizeof(encoder->prev));
+
+    //Size the buffer for the common case where only a few fields change per sample.
+    //It is grown if needed.
+    encoder->payload_cap = ((size_t) encoder->max_samples)*8 + SIR_TRACE_MAX_SAMPLE_BYTES;
+    encoder->payload_bytes = 0;
+    encoder->payload = (uint8_t*) malloc(encoder->payload_cap);
+    if(encoder->payload == NULL){
+        printf("Unable to allocate trace chunk buffer\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+void sir_trace_encoder_free(sir_trace_encoder_t* encoder){
+    free(encoder->payload);
+    encoder->payload = NULL;
+}
+
+int sir_trace_flush(sir_trace_writer_t* writer, sir_trace_encoder_t* encoder){
+    struct sir_trace_chunk_header chunk;
+    int rtn = 0;
+
+    if(encoder->num_samples == 0){
+        return 0;
+    }
+
+    chunk.cpu = encoder->cpu;
+    chunk.num_samples = encoder->num_samples;
+    chunk.first_time_ns = encoder->first_time_ns;
+    chunk.last_time_ns = encoder->prev_time_ns;
+    chunk.payload_bytes = encoder->payload_bytes;
+
+    pthread_mutex_lock(&(writer->lock));
+
+    if(writer->num_chunks == writer->index_cap){
+        uint64_t new_cap = writer->index_cap == 0 ? 64 : writer->index_cap*2;
+        struct sir_trace_index_entry* new_index = (struct sir_trace_index_entry*) realloc(writer->index, new_cap*sizeof(struct sir_trace_index_entry));
+        if(new_index == NULL){
+            printf("Unable to grow trace index\n");
+            pthread_mutex_unlock(&(writer->lock));
+            return -1;
+        }
+        writer->index = new_index;
+        writer->index_cap = new_cap;
+    }
+
+    if(fwrite(&chunk, sizeof(chunk), 1, writer->file) != 1 ||
+       fwrite(encoder->payload, 1, encoder->payload_bytes, writer->file) != encoder->payload_bytes){
+        perror("Unable to write trace chunk");
+        rtn = -1;
+    }else{
+        struct sir_trace_index_entry* entry = &(writer->index[writer->num_chunks]);
+        entry->cpu = chunk.cpu;
+        entry->num_samples = chunk.num_samples;
+        entry->first_time_ns = chunk.first_time_ns;
+        entry->last_time_ns = chunk.last_time_ns;
+        entry->offset = writer->offset;
+        writer->num_chunks++;
+        writer->offset += sizeof(chunk) + encoder->payload_bytes;
+    }
+
+    pthread_mutex_unlock(&(writer->lock));
+
+    //Start the next chunk from a zero baseline so it can be decoded independently
+    encoder->num_samples = 0;
+    encoder->payload_bytes = 0;
+    encoder->prev_time_ns = 0;
+    memset(encoder->prev, 0, sizeof(encoder->prev));
+
+    return rtn;
+}
+
+int sir_trace_append(sir_trace_writer_t* writer, sir_trace_encoder_t* encoder, uint64_t time_ns, const struct sir_report* report){
+    SIR_INTERRUPT_TYPE vals[SIR_REPORT_NUM_FIELDS];
+    uint64_t mask = 0;
+    uint8_t* pos;
+
+    if(encoder->payload_cap - encoder->payload_bytes < SIR_TRACE_MAX_SAMPLE_BYTES){
+        size_t new_cap = encoder->payload_cap*2;
+        uint8_t* new_payload = (uint8_t*) realloc(encoder->payload, new_cap);
+        if(new_payload == NULL){
+            printf("Unable to grow trace chunk buffer\n");
+            return -1;
+        }
+        encoder->payload = new_payload;
+        encoder->payload_cap = new_cap;
+    }
+
+    sir_report_to_array(report, vals);
+    for(size_t i = 0; i<SIR_REPORT_NUM_FIELDS; i++){
+        if(vals[i] != encoder->prev[i]){
+            mask |= 1ULL << i;
+        }
+    }
+
+    if(encoder->num_samples == 0){
+        encoder->first_time_ns = time_ns;
+    }
+
+    pos = encoder->payload + encoder->payload_bytes;
+    pos = put_varint(pos, time_ns - encoder->prev_time_ns);
+    pos = put_varint(pos, mask);
+    for(size_t i = 0; i<SIR_REPORT_NUM_FIELDS; i++){
+        if(mask & (1ULL << i)){
+            pos = put_varint(pos, zigzag_encode((int64_t) (vals[i] - encoder->prev[i])));
+        }
+    }
+    encoder->payload_bytes = pos - encoder->payload;
+
+    memcpy(encoder->prev, vals, sizeof(vals));
+    encoder->prev_time_ns = time_ns;
+    encoder->num_samples++;
+
+    if(encoder->num_samples >= encoder->max_samples){
+        return sir_trace_flush(writer, encoder);
+    }
+
+    return 0;
+}
+
+//==== Reader ====
+
+//Walks the chunk headers to rebuild the index of a trace which was not finalized
+static int rebuild_index(sir_trace_reader_t* reader){
+    uint64_t offset = sizeof(struct sir_trace_file_header);
+    uint64_t cap = 64;
+
+    reader->rebuilt_index = (struct sir_trace_index_entry*) malloc(cap*sizeof(struct sir_trace_index_entry));
+    if(reader->rebuilt_index == NULL){
+        printf("Unable to allocate trace index\n");
+        return -1;
+    }
+    reader->num_chunks = 0;
+
+    while(offset + sizeof(struct sir_trace_chunk_header) <= reader->len){
+        struct sir_trace_chunk_header chunk;
+        memcpy(&chunk, reader->base + offset, sizeof(chunk));
+        if(chunk.payload_bytes > reader->len - offset - sizeof(chunk)){
+            //Truncated chunk at the end of the trace
+            break;
+        }
+        if(chunk.cpu >= SIR_TRACE_MAX_CPUS){
+            printf("Corrupt chunk header at offset %lu, ignoring the rest of the trace\n", offset);
+            break;
+        }
+
+        if(reader->num_chunks == cap){
+            struct sir_trace_index_entry* new_index;
+            cap *= 2;
+            new_index = (struct sir_trace_index_entry*) realloc(reader->rebuilt_index, cap*sizeof(struct sir_trace_index_entry));
+            if(new_index == NULL){
+                printf("Unable to grow trace index\n");
+                return -1;
+            }
+            reader->rebuilt_index = new_index;
+        }
+
+        reader->rebuilt_index[reader->num_chunks].cpu = chunk.cpu;
+        reader->rebuilt_index[reader->num_chunks].num_samples = chunk.num_samples;
+        reader->rebuilt_index[reader->num_chunks].first_time_ns = chunk.first_time_ns;
+        reader->rebuilt_index[reader->num_chunks].last_time_ns = chunk.last_time_ns;
+        reader->rebuilt_index[reader->num_chunks].offset = offset;
+        reader->num_chunks++;
+
+        offset += sizeof(chunk) + chunk.payload_bytes;
+    }
+
+    reader->index = reader->rebuilt_index;
+    return 0;
+}
+
+int sir_trace_reader_open(sir_trace_reader_t* reader, const char* path){
+    struct stat st;
+    void* base;
+
+    reader->base = NULL;
+    reader->rebuilt_index = NULL;
+
+    reader->fd = open(path, O_RDONLY);
+    if(reader->fd < 0){
+        perror("Unable to open trace file");
+        return -1;
+    }
+
+    if(fstat(reader->fd, &st) != 0){
+        perror("Unable to stat trace file");
+        close(reader->fd);
+        return -1;
+    }
+
+    if(st.st_size < (off_t) sizeof(struct sir_trace_file_header)){
+        printf("Trace file is too short\n");
+        close(reader->fd);
+        return -1;
+    }
+
+    base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, reader->fd, 0);
+    if(base == MAP_FAILED){
+        perror("Unable to map trace file");
+        close(reader->fd);
+        return -1;
+    }
+    //The trace is read in a single forward pass
+    madvise(base, st.st_size, MADV_SEQUENTIAL);
+
+    reader->base = (const uint8_t*) base;
+    reader->len = st.st_size;
+    reader->header = (const struct sir_trace_file_header*) base;
+
+    if(memcmp(reader->header->magic, SIR_TRACE_MAGIC, sizeof(reader->header->magic)) != 0 || reader->header->version != SIR_TRACE_VERSION){
+        printf("Not a sir trace file (or unsupported version)\n");
+        sir_trace_reader_close(reader);
+        return -1;
+    }
+
+    if(reader->header->num_fields != SIR_REPORT_NUM_FIELDS){
+        printf("Trace was recorded with %u fields per sample but this tool expects %lu\n", reader->header->num_fields, SIR_REPORT_NUM_FIELDS);
+        sir_trace_reader_close(reader);
+        return -1;
+    }
+
+    if(reader->header->index_offset == 0 ||
+       reader->header->index_offset > reader->len ||
+       reader->header->num_chunks > (reader->len - reader->header->index_offset)/sizeof(struct sir_trace_index_entry)){
+        printf("Trace index missing, rebuilding from chunk headers\n");
+        if(rebuild_index(reader) != 0){
+            sir_trace_reader_close(reader);
+            return -1;
+        }
+    }else{
+        reader->index = (const struct sir_trace_index_entry*) (reader->base + reader->header->index_offset);
+        reader->num_chunks = reader->header->num_chunks;
+    }
+
+    //The tools index per-CPU state by the CPU in the index
+    for(uint64_t i = 0; i<reader->num_chunks; i++){
+        if(reader->index[i].cpu >= SIR_TRACE_MAX_CPUS){
+            printf("Corrupt trace index (entry %lu has CPU %u)\n", i, reader->index[i].cpu);
+            sir_trace_reader_close(reader);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+void sir_trace_reader_close(sir_trace_reader_t* reader){
+    if(reader->base != NULL){
+        munmap((void*) reader->base, reader->len);
+        reader->base = NULL;
+    }
+    free(reader->rebuilt_index);
+    reader->rebuilt_index = NULL;
+    close(reader->fd);
+}
+
+int sir_trace_cursor_init(const sir_trace_reader_t* reader, uint64_t chunk, sir_trace_cursor_t* cursor){
+    const struct sir_trace_index_entry* entry;
+    struct sir_trace_chunk_header header;
+
+    if(chunk >= reader->num_chunks){
+        return -1;
+    }
+
+    entry = &(reader->index[chunk]);
+    if(entry->offset + sizeof(header) > reader->len){
+        return -1;
+    }
+    memcpy(&header, reader->base + entry->offset, sizeof(header));
+    if(header.payload_bytes > reader->len - entry->offset - sizeof(header)){
+        return -1;
+    }
+
+    cursor->pos = reader->base + entry->offset + sizeof(header);
+    cursor->end = cursor->pos + header.payload_bytes;
+    cursor->remaining = header.num_samples;
+    cursor->time_ns = 0;
+    memset(cursor->vals, 0, sizeof(cursor->vals));
+
+    return 0;
+}
+
+int sir_trace_cursor_next(sir_trace_cursor_t* cursor, uint64_t* time_ns, struct sir_report* report){
+    uint64_t time_delta;
+    uint64_t mask;
+
+    if(cursor->remaining == 0){
+        return 0;
+    }
+
+    cursor->pos = get_varint(cursor->pos, cursor->end, &time_delta);
+    if(cursor->pos == NULL){
+        return -1;
+    }
+    cursor->pos = get_varint(cursor->pos, cursor->end, &mask);
+    if(cursor->pos == NULL){
+        return -1;
+    }
+
+    for(size_t i = 0; i<SIR_REPORT_NUM_FIELDS; i++){
+        if(mask & (1ULL << i)){
+            uint64_t delta;
+            cursor->pos = get_varint(cursor->pos, cursor->end, &delta);
+            if(cursor->pos == NULL){
+                return -1;
+            }
+            cursor->vals[i] += (SIR_INTERRUPT_TYPE) zigzag_decode(delta);
+        }
+    }
+
+    cursor->time_ns += time_delta;
+    cursor->remaining--;
+
+    *time_ns = cursor->time_ns;
+    sir_report_from_array(cursor->vals, report);
+
+    return 1;
+}
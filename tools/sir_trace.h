@@ -0,0 +1,149 @@
+/**
+ * Compact binary trace format for recorded sir_report samples
+ *
+ * Successive samples from a CPU change very little so each sample is
+ * stored as the set of fields which changed since the previous sample
+ * from the same CPU, with the deltas varint encoded.
+ *
+ * File Layout:
+ *   struct sir_trace_file_header
+ *   chunk 0: struct sir_trace_chunk_header + payload
+ *   chunk 1: ...
+ *   struct sir_trace_index_entry[num_chunks]
+ *
+ * Each chunk holds samples from a single CPU.  The first sample in a chunk
+ * is encoded against an all zero baseline so a chunk can be decoded without
+ * reading any of the chunks before it.  The index at the end of the file
+ * lists every chunk with its CPU and time span.  If the recorder did not
+ * finish (index_offset == 0), the index can be rebuilt by walking the chunk
+ * headers.
+ *
+ * Sample Encoding (within a chunk payload):
+ *   varint: time delta (ns) since the previous sample in the chunk (since 0 for the first)
+ *   varint: bitmask of fields which changed (bit i = field i of struct sir_report)
+ *   for each set bit, in increasing order: zigzag varint of the field delta
+ *
+ * All fixed width values are stored little endian (the native byte order
+ * of the x86 hosts sir supports).
+ */
+#ifndef _H_SIR_TRACE
+#define _H_SIR_TRACE
+
+#include <stdint.h>
+#include <stdio.h>
+#include <pthread.h>
+
+#include "sir_util.h"
+
+#define SIR_TRACE_MAGIC "SIRTRACE"
+#define SIR_TRACE_VERSION 1
+#define SIR_TRACE_DEFAULT_CHUNK_SAMPLES 4096
+#define SIR_TRACE_MAX_CPUS 8192 //Largest NR_CPUS the kernel supports
+
+//Worst case encoded size of a single sample
+//(10 bytes per varint for the time, mask, and each field)
+#define SIR_TRACE_MAX_SAMPLE_BYTES (10*(2+SIR_REPORT_NUM_FIELDS))
+
+struct sir_trace_file_header{
+    char magic[8];
+    uint32_t version;
+    uint32_t num_fields;     //Number of fields in struct sir_report when recorded
+    uint64_t start_time_ns;  //CLOCK_MONOTONIC time when recording started
+    uint64_t index_offset;   //Offset of the chunk index (0 if the trace was not finalized)
+    uint64_t num_chunks;     //Number of entries in the chunk index
+};
+
+struct sir_trace_chunk_header{
+    uint32_t cpu;
+    uint32_t num_samples;
+    uint64_t first_time_ns;
+    uint64_t last_time_ns;
+    uint64_t payload_bytes;
+};
+
+struct sir_trace_index_entry{
+    uint32_t cpu;
+    uint32_t num_samples;
+    uint64_t first_time_ns;
+    uint64_t last_time_ns;
+    uint64_t offset;         //Offset of the chunk header in the file
+};
+
+// ==== Writer ====
+
+//Encoder state for a single CPU.  Each sampling thread owns one of these.
+typedef struct{
+    uint32_t cpu;
+    uint32_t num_samples;
+    uint32_t max_samples;
+    uint64_t first_time_ns;
+    uint64_t prev_time_ns;
+    SIR_INTERRUPT_TYPE prev[SIR_REPORT_NUM_FIELDS];
+    uint8_t* payload;
+    size_t payload_bytes;
+    size_t payload_cap;
+} sir_trace_encoder_t;
+
+//Writer shared between all of the encoders recording to the same file
+typedef struct{
+    FILE* file;
+    pthread_mutex_t lock;
+    uint64_t start_time_ns;
+    uint64_t offset;
+    struct sir_trace_index_entry* index;
+    uint64_t num_chunks;
+    uint64_t index_cap;
+} sir_trace_writer_t;
+
+//Creates a trace file.  Returns 0 on success and -1 on error
+int sir_trace_writer_open(sir_trace_writer_t* writer, const char* path, uint64_t start_time_ns);
+
+//Writes the chunk index, updates the file header, and closes the file.
+//All encoders must be flushed before this is called
+int sir_trace_writer_close(sir_trace_writer_t* writer);
+
+//Initializes an encoder for the given CPU.  Returns 0 on success and -1 on error
+int sir_trace_encoder_init(sir_trace_encoder_t* encoder, uint32_t cpu, uint32_t max_samples);
+void sir_trace_encoder_free(sir_trace_encoder_t* encoder);
+
+//Adds a sample to the encoder's current chunk.  The chunk is written to the
+//file once it holds max_samples samples.  Returns 0 on success and -1 on error
+int sir_trace_append(sir_trace_writer_t* writer, sir_trace_encoder_t* encoder, uint64_t time_ns, const struct sir_report* report);
+
+//Writes any samples in the encoder's current chunk to the file
+int sir_trace_flush(sir_trace_writer_t* writer, sir_trace_encoder_t* encoder);
+
+// ==== Reader ====
+
+typedef struct{
+    int fd;
+    const uint8_t* base;
+    size_t len;
+    const struct sir_trace_file_header* header;
+    const struct sir_trace_index_entry* index;
+    uint64_t num_chunks;
+    struct sir_trace_index_entry* rebuilt_index; //Only allocated if the trace was not finalized
+} sir_trace_reader_t;
+
+//Cursor for decoding the samples in a single chunk
+typedef struct{
+    const uint8_t* pos;
+    const uint8_t* end;
+    uint32_t remaining;
+    uint64_t time_ns;
+    SIR_INTERRUPT_TYPE vals[SIR_REPORT_NUM_FIELDS];
+} sir_trace_cursor_t;
+
+//Maps a trace file.  Every index entry has cpu < SIR_TRACE_MAX_CPUS.
+//Returns 0 on success and -1 on error
+int sir_trace_reader_open(sir_trace_reader_t* reader, const char* path);
+void sir_trace_reader_close(sir_trace_reader_t* reader);
+
+//Starts decoding the given chunk.  Returns 0 on success and -1 on error
+int sir_trace_cursor_init(const sir_trace_reader_t* reader, uint64_t chunk, sir_trace_cursor_t* cursor);
+
+//Decodes the next sample in the chunk
+//Returns 1 if a sample was decoded, 0 at the end of the chunk, and -1 if the chunk is corrupt
+int sir_trace_cursor_next(sir_trace_cursor_t* cursor, uint64_t* time_ns, struct sir_report* report);
+
+#endif
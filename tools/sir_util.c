@@ -0,0 +1,212 @@
+/**
+ * Shared helpers for the sir userspace tools
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/ioctl.h>
+
+#include "sir_util.h"
+
+_Static_assert(sizeof(struct sir_report) % sizeof(SIR_INTERRUPT_TYPE) == 0, "sir_report must only contain SIR_INTERRUPT_TYPE entries");
+
+const char* sir_report_field_names[] = {
+    "irq_std",
+    "irq_nmi",
+    "irq_loc",
+    "irq_spu",
+    "irq_pmi",
+    "irq_iwi",
+    "irq_rtr",
+    "irq_plt",
+    "irq_res",
+    "irq_cal",
+    "irq_tlb",
+    "irq_trm",
+    "irq_thr",
+    "irq_dfr",
+    "mce_exception",
+    "mce_poll",
+    "irq_hyp",
+    "irq_pin",
+    "irq_npi",
+    "irq_piw",
+    "arch_irq_stat_sum",
+    "softirq_hi",
+    "softirq_timer",
+    "softirq_net_tx",
+    "softirq_net_rx",
+    "softirq_block",
+    "softirq_irq_poll",
+    "softirq_tasklet",
+    "softirq_sched",
+    "softirq_hrtimer",
+    "softirq_rcu",
+    "softirq_other"
+};
+
+_Static_assert(sizeof(sir_report_field_names)/sizeof(sir_report_field_names[0]) == SIR_REPORT_NUM_FIELDS, "sir_report_field_names is out of sync with sir.h");
+
+const char* sir_report_field_help[] = {
+    "Standard interrupts (not x86 specific)",
+    "NMI: Non-maskable interrupts",
+    "LOC: Local timer interrupts",
+    "SPU: Spurious interrupts",
+    "PMI: Performance monitoring interrupts",
+    "IWI: IRQ work interrupts",
+    "RTR: APIC ICR read retries",
+    "PLT: Platform interrupts",
+    "RES: Rescheduling interrupts",
+    "CAL: Function call interrupts",
+    "TLB: TLB shootdowns",
+    "TRM: Thermal event interrupts",
+    "THR: Threshold APIC interrupts",
+    "DFR: Deferred Error APIC interrupts",
+    "MCE: Machine check exceptions",
+    "MCP: Machine check polls",
+    "HYP: Hypervisor callback interrupts",
+    "PIN: Posted-interrupt notification events",
+    "NPI: Nested posted-interrupt events",
+    "PIW: Posted-interrupt wakeup events",
+    "Sum of the x86 specific interrupts (arch_irq_stat_cpu)",
+    "HI softirqs",
+    "TIMER softirqs",
+    "NET_TX softirqs",
+    "NET_RX softirqs",
+    "BLOCK softirqs",
+    "IRQ_POLL softirqs",
+    "TASKLET softirqs",
+    "SCHED softirqs",
+    "HRTIMER softirqs",
+    "RCU softirqs",
+    "Other softirqs"
+};
+
+_Static_assert(sizeof(sir_report_field_help)/sizeof(sir_report_field_help[0]) == SIR_REPORT_NUM_FIELDS, "sir_report_field_help is out of sync with sir.h");
+
+void sir_report_to_array(const struct sir_report* report, SIR_INTERRUPT_TYPE* vals){
+    memcpy(vals, report, sizeof(struct sir_report));
+}
+
+void sir_report_from_array(const SIR_INTERRUPT_TYPE* vals, struct sir_report* report){
+    memcpy(report, vals, sizeof(struct sir_report));
+}
+
+SIR_INTERRUPT_TYPE sir_report_irq_total(const struct sir_report* report){
+    return report->irq_std + report->arch_irq_stat_sum;
+}
+
+SIR_INTERRUPT_TYPE sir_report_softirq_total(const struct sir_report* report){
+    SIR_INTERRUPT_TYPE vals[SIR_REPORT_NUM_FIELDS];
+    SIR_INTERRUPT_TYPE sum = 0;
+    sir_report_to_array(report, vals);
+    for(size_t i = SIR_REPORT_FIRST_SOFTIRQ; i<SIR_REPORT_NUM_FIELDS; i++){
+        sum += vals[i];
+    }
+    return sum;
+}
+
+int sir_report_field_index(const char* name){
+    for(size_t i = 0; i<SIR_REPORT_NUM_FIELDS; i++){
+        if(strcmp(sir_report_field_names[i], name) == 0){
+            return i;
+        }
+    }
+    return -1;
+}
+
+SIR_INTERRUPT_TYPE sir_counter_delta(int idx, SIR_INTERRUPT_TYPE cur, SIR_INTERRUPT_TYPE prev){
+    SIR_INTERRUPT_TYPE delta = cur - prev;
+    if(idx == 0){
+        return delta;
+    }else if(idx == SIR_PMU_EVENT_IRQ_TOTAL){
+        //irq_std (64 bit) plus the 32 bit x86 counters: undo each wrap of the x86 part
+        while((int64_t) delta < 0){
+            delta += 1ULL << 32;
+        }
+        return delta;
+    }
+    return (uint32_t) delta;
+}
+
+int sir_read_all(int fd, struct sir_report* reports, uint32_t num_reports){
+    struct sir_batch batch;
+    batch.num_reports = num_reports;
+    batch.num_cpus = 0;
+    batch.reports = (uint64_t) (uintptr_t) reports;
+    if(ioctl(fd, SIR_IOCTL_GET_ALL, &batch) < 0){
+        return -1;
+    }
+    return batch.num_reports;
+}
+
+int sir_read_all_tick(int fd, struct sir_tick_report* reports, uint32_t num_reports){
+    struct sir_batch batch;
+    batch.num_reports = num_reports;
+    batch.num_cpus = 0;
+    batch.reports = (uint64_t) (uintptr_t) reports;
+    if(ioctl(fd, SIR_IOCTL_GET_ALL_TICK, &batch) < 0){
+        return -1;
+    }
+    return batch.num_reports;
+}
+
+int sir_num_cpus(int fd){
+    struct sir_report report;
+    struct sir_batch batch;
+    batch.num_reports = 0;
+    batch.num_cpus = 0;
+    batch.reports = (uint64_t) (uintptr_t) &report;
+    if(ioctl(fd, SIR_IOCTL_GET_ALL, &batch) < 0){
+        return -1;
+    }
+    return batch.num_cpus;
+}
+
+int sir_parse_cpu_list(const char* list, cpu_set_t* cpu_set){
+    const char* pos = list;
+    CPU_ZERO(cpu_set);
+
+    while(*pos != '\0'){
+        char* end;
+        long start = strtol(pos, &end, 10);
+        long stop = start;
+        if(end == pos || start < 0){
+            return -1;
+        }
+        pos = end;
+
+        if(*pos == '-'){
+            pos++;
+            stop = strtol(pos, &end, 10);
+            if(end == pos || stop < start){
+                return -1;
+            }
+            pos = end;
+        }
+
+        if(stop >= CPU_SETSIZE){
+            return -1;
+        }
+
+        for(long cpu = start; cpu<=stop; cpu++){
+            CPU_SET(cpu, cpu_set);
+        }
+
+        if(*pos == ','){
+            pos++;
+        }else if(*pos != '\0'){
+            return -1;
+        }
+    }
+
+    return CPU_COUNT(cpu_set) > 0 ? 0 : -1;
+}
+
+uint64_t sir_time_ns(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t) ts.tv_sec)*1000000000ULL + ts.tv_nsec;
+}
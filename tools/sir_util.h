@@ -0,0 +1,69 @@
+/**
+ * Shared helpers for the sir userspace tools
+ */
+#ifndef _H_SIR_UTIL
+#define _H_SIR_UTIL
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sched.h>
+
+#include "../module/sir.h"
+
+//The sir_report structure only contains SIR_INTERRUPT_TYPE entries
+//so it can be treated as an array of counters indexed in the order
+//the fields are declared in sir.h
+#define SIR_REPORT_NUM_FIELDS (sizeof(struct sir_report)/sizeof(SIR_INTERRUPT_TYPE))
+
+//Index of the first softirq field in struct sir_report
+#define SIR_REPORT_FIRST_SOFTIRQ 21
+//Index of arch_irq_stat_sum in struct sir_report
+#define SIR_REPORT_ARCH_SUM 20
+
+//Names of the fields in struct sir_report (in declaration order)
+extern const char* sir_report_field_names[];
+//Short descriptions of the fields in struct sir_report (in declaration order)
+extern const char* sir_report_field_help[];
+
+//Copies a report to/from an array of SIR_REPORT_NUM_FIELDS counters
+void sir_report_to_array(const struct sir_report* report, SIR_INTERRUPT_TYPE* vals);
+void sir_report_from_array(const SIR_INTERRUPT_TYPE* vals, struct sir_report* report);
+
+//Returns the total number of hardware interrupts in the report.  This is the same
+//value returned by SIR_IOCTL_GET (irq_std + arch_irq_stat_sum)
+SIR_INTERRUPT_TYPE sir_report_irq_total(const struct sir_report* report);
+
+//Returns the total number of softirqs in the report
+SIR_INTERRUPT_TYPE sir_report_softirq_total(const struct sir_report* report);
+
+//Returns the index of the named field or -1 if it does not exist
+int sir_report_field_index(const char* name);
+
+//Returns the change in a counter between two reads.  idx is a struct sir_report
+//field index, SIR_PMU_EVENT_IRQ_TOTAL, or SIR_PMU_EVENT_SOFTIRQ_TOTAL (the perf
+//event numbering).  Other than irq_std, the counters are 32 bit kernel counters
+//(or sums of them) which wrap, so the change is taken modulo 2^32.  Assumes fewer
+//than 2^32 events between the reads.
+SIR_INTERRUPT_TYPE sir_counter_delta(int idx, SIR_INTERRUPT_TYPE cur, SIR_INTERRUPT_TYPE prev);
+
+//Reads the report for every CPU using a single SIR_IOCTL_GET_ALL call.
+//reports[i] is set to the report for CPU i.  Returns the number of
+//reports written or -1 on error
+int sir_read_all(int fd, struct sir_report* reports, uint32_t num_reports);
+
+//Reads the report and tick state for every CPU using a single SIR_IOCTL_GET_ALL_TICK
+//call.  reports[i] is set to the report for CPU i.  Returns the number of reports
+//written or -1 on error
+int sir_read_all_tick(int fd, struct sir_tick_report* reports, uint32_t num_reports);
+
+//Returns the number of possible CPUs known to the sir module or -1 on error
+int sir_num_cpus(int fd);
+
+//Parses a CPU list of the form "0-3,8,10-11" into a cpu_set_t
+//Returns 0 on success and -1 if the list is malformed
+int sir_parse_cpu_list(const char* list, cpu_set_t* cpu_set);
+
+//Gets the current CLOCK_MONOTONIC time in ns
+uint64_t sir_time_ns(void);
+
+#endif